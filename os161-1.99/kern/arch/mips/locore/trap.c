@@ -194,6 +194,14 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+		/*
+		 * If we interrupted a user thread whose process is
+		 * exiting, don't go back to it.
+		 */
+		if (!iskern) {
+			uthread_checkexit();
+		}
 		goto done2;
 	}
 
@@ -221,6 +229,7 @@ mips_trap(struct trapframe *tf)
 		      tf->tf_v0, tf->tf_a0, tf->tf_a1, tf->tf_a2, tf->tf_a3);
 
 		syscall(tf);
+		uthread_checkexit();
 		goto done;
 	}
 
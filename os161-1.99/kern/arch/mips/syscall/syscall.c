@@ -30,18 +30,20 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/syscall.h>
+#include <kern/sysring.h>
 #include <lib.h>
 #include <mips/trapframe.h>
 #include <thread.h>
 #include <current.h>
+#include <addrspace.h>
+#include <copyinout.h>
 #include <syscall.h>
+#include <syscallstat.h>
+#include "opt-syscallstat.h"
 
 
 /*
- * System call dispatcher.
- *
- * A pointer to the trapframe created during exception entry (in
- * exception.S) is passed in.
+ * System call table.
  *
  * The calling conventions for syscalls are as follows: Like ordinary
  * function calls, the first 4 32-bit arguments are passed in the 4
@@ -65,28 +67,187 @@
  * returning the value -1 from the actual userlevel syscall function.
  * See src/user/lib/libc/arch/mips/syscalls-mips.S and related files.)
  *
- * Upon syscall return the program counter stored in the trapframe
- * must be incremented by one instruction; otherwise the exception
- * return code will restart the "syscall" instruction and the system
- * call will repeat forever.
- *
  * If you run out of registers (which happens quickly with 64-bit
  * values) further arguments must be fetched from the user-level
  * stack, starting at sp+16 to skip over the slots for the
  * registerized values, with copyin().
+ *
+ * Because the kernel uses the same conventions, the dispatcher
+ * doesn't need to know the types of the arguments: it collects
+ * sd_nargs 32-bit words, the registers and then the stack, into an
+ * array, and calls the handler with the words in the same positions.
+ * A 64-bit argument then lands in the aligned pair the handler
+ * expects it in, and an unused a1 is just passed along and ignored.
+ * The descriptor says how many words to pass, counting any such
+ * padding, and how the handler returns its value:
+ *
+ *    SYSRET_NONE      int sys_foo(args...); returns 0 on success.
+ *    SYSRET_INT       int sys_foo(args..., int32_t *retval);
+ *    SYSRET_OFF       int sys_foo(args..., off_t *retval); the 64-bit
+ *                     value goes back in v0/v1.
+ *    SYSRET_NEVER     void sys_foo(args...); does not return.
+ *
+ * The return value pointer goes in the word after the arguments,
+ * which is also where the handler looks for it. A descriptor with
+ * SYSARG_TRAPFRAME set gets the trapframe as its single argument
+ * instead of anything from userlevel. SYSF_BATCH marks calls that may
+ * also be submitted through a sysring (see <kern/sysring.h>).
+ *
+ * Adding a system call is a matter of adding a line to the table.
  */
-void
-syscall(struct trapframe *tf)
+
+#define SYSRET_NONE		0
+#define SYSRET_INT		1
+#define SYSRET_OFF		2
+#define SYSRET_NEVER		3
+
+#define SYSARG_TRAPFRAME	0x100
+#define SYSF_BATCH		0x200
+#define SYSRET_MASK		0x0ff
+
+/* Most words any handler takes, counting the return value pointer. */
+#define SYSCALL_MAXWORDS	8
+
+/*
+ * Generic handler type; cast to the right number of words to call.
+ */
+typedef void (*syscall_fn_t)(void);
+
+struct syscall_desc {
+	const char *sd_name;		/* name, without "sys_" */
+	syscall_fn_t sd_func;		/* handler; NULL if none */
+	unsigned sd_nargs;		/* argument words */
+	unsigned sd_flags;		/* SYSRET_* | SYSARG_* | SYSF_* */
+};
+
+/*
+ * Calls marked SYSF_BATCH must fit in a sysring entry; the sizeof
+ * term checks that at build time (in the style of COMPILE_ASSERT,
+ * which can't be used in an initializer) and is otherwise 0.
+ */
+#define SYSCALL_NARGS(nargs, flags) \
+	((nargs) + 0 * sizeof(struct { unsigned : \
+		(((flags) & SYSF_BATCH) == 0 || \
+		 (nargs) <= SYSRING_MAXARGS) ? 1 : -1; }))
+
+#define SYSCALL(name, nargs, flags) \
+	[SYS_##name] = { #name, (syscall_fn_t)sys_##name, \
+			 SYSCALL_NARGS(nargs, flags), flags }
+
+static const struct syscall_desc syscall_table[] = {
+	SYSCALL(reboot,		1, SYSRET_NONE),
+	SYSCALL(__time,		2, SYSRET_NONE),
+	SYSCALL(nanosleep,	2, SYSRET_NONE),
+	SYSCALL(futex_wait,	2, SYSRET_NONE),
+	SYSCALL(futex_wake,	2, SYSRET_INT),
+	SYSCALL(__threadfork,	3, SYSRET_INT),
+	SYSCALL(threadexit,	1, SYSRET_NEVER),
+	SYSCALL(threadjoin,	2, SYSRET_NONE),
+	SYSCALL(setpriority,	3, SYSRET_NONE),
+	SYSCALL(execv,		2, SYSRET_NONE),
+	SYSCALL(spawn,		2, SYSRET_INT),
+	SYSCALL(sysring_enter,	1, SYSRET_INT),
+#if OPT_SYSCALLSTAT
+	SYSCALL(syscallstats,	2, SYSRET_NONE),
+#endif
+#ifdef UW
+	SYSCALL(open,		3, SYSRET_INT),
+	SYSCALL(close,		1, SYSRET_NONE | SYSF_BATCH),
+	SYSCALL(read,		3, SYSRET_INT | SYSF_BATCH),
+	SYSCALL(write,		3, SYSRET_INT | SYSF_BATCH),
+	/* fd in a0; a1 unused; pos in a2-a3; whence on the stack */
+	SYSCALL(lseek,		5, SYSRET_OFF | SYSF_BATCH),
+	SYSCALL(dup2,		2, SYSRET_INT),
+	SYSCALL(readv,		3, SYSRET_INT | SYSF_BATCH),
+	SYSCALL(writev,		3, SYSRET_INT | SYSF_BATCH),
+	/* fd, iov, iovcnt in a0-a2; a3 unused; offset on the stack */
+	SYSCALL(preadv,		6, SYSRET_INT | SYSF_BATCH),
+	SYSCALL(pwritev,	6, SYSRET_INT | SYSF_BATCH),
+	/* fdin, fdout in a0-a1; offset in a2-a3; len on the stack */
+	SYSCALL(copyfile,	5, SYSRET_INT | SYSF_BATCH),
+	SYSCALL(_exit,		1, SYSRET_NEVER),
+	SYSCALL(fork,		1, SYSRET_INT | SYSARG_TRAPFRAME),
+	SYSCALL(vfork,		1, SYSRET_INT | SYSARG_TRAPFRAME),
+	SYSCALL(getpid,		0, SYSRET_INT),
+	SYSCALL(waitpid,	3, SYSRET_INT),
+#endif // UW
+};
+
+#define NSYSCALLS (sizeof(syscall_table) / sizeof(syscall_table[0]))
+
+/*
+ * Look up the descriptor for CALLNO; NULL if there's no such call.
+ */
+static
+const struct syscall_desc *
+syscall_lookup(int callno)
 {
-	int callno;
+	if (callno < 0 || (unsigned)callno >= NSYSCALLS ||
+	    syscall_table[callno].sd_func == NULL) {
+		return NULL;
+	}
+	return &syscall_table[callno];
+}
+
+/*
+ * Name of system call CALLNO, for statistics; NULL if there's no
+ * such call.
+ */
+const char *
+syscall_name(int callno)
+{
+	const struct syscall_desc *sd;
+
+	sd = syscall_lookup(callno);
+	return sd == NULL ? NULL : sd->sd_name;
+}
+
+/*
+ * Call a handler with the first NWORDS words of ARGS.
+ */
+static
+int
+syscall_call(syscall_fn_t func, const uint32_t *a, unsigned nwords)
+{
+	typedef uint32_t w;
+
+	switch (nwords) {
+	    case 0: return ((int (*)(void))func)();
+	    case 1: return ((int (*)(w))func)(a[0]);
+	    case 2: return ((int (*)(w,w))func)(a[0], a[1]);
+	    case 3: return ((int (*)(w,w,w))func)(a[0], a[1], a[2]);
+	    case 4: return ((int (*)(w,w,w,w))func)(a[0], a[1], a[2], a[3]);
+	    case 5: return ((int (*)(w,w,w,w,w))func)(a[0], a[1], a[2],
+						      a[3], a[4]);
+	    case 6: return ((int (*)(w,w,w,w,w,w))func)(a[0], a[1], a[2],
+							a[3], a[4], a[5]);
+	    case 7: return ((int (*)(w,w,w,w,w,w,w))func)(a[0], a[1], a[2],
+							  a[3], a[4], a[5],
+							  a[6]);
+	    case 8: return ((int (*)(w,w,w,w,w,w,w,w))func)(a[0], a[1], a[2],
+							    a[3], a[4], a[5],
+							    a[6], a[7]);
+	}
+	panic("syscall_call: %u argument words\n", nwords);
+}
+
+/*
+ * Call the handler SD with the argument words in ARGS, which must
+ * have room for the return value pointer after them. Not for calls
+ * that don't return.
+ */
+static
+int
+syscall_invoke(const struct syscall_desc *sd, uint32_t *args,
+	       int64_t *retp)
+{
+	unsigned nwords;
 	int32_t retval;
+	off_t retval64;
 	int err;
 
-	KASSERT(curthread != NULL);
-	KASSERT(curthread->t_curspl == 0);
-	KASSERT(curthread->t_iplhigh_count == 0);
-
-	callno = tf->tf_v0;
+	nwords = sd->sd_nargs;
+	KASSERT(nwords < SYSCALL_MAXWORDS);
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -96,49 +257,114 @@ syscall(struct trapframe *tf)
 	 * deal with it except for calls that return other values, 
 	 * like write.
 	 */
-
 	retval = 0;
+	retval64 = 0;
 
-	switch (callno) {
-	    case SYS_reboot:
-		err = sys_reboot(tf->tf_a0);
+	switch (sd->sd_flags & SYSRET_MASK) {
+	    case SYSRET_NONE:
+		err = syscall_call(sd->sd_func, args, nwords);
+		*retp = 0;
 		break;
 
-	    case SYS___time:
-		err = sys___time((userptr_t)tf->tf_a0,
-				 (userptr_t)tf->tf_a1);
+	    case SYSRET_INT:
+		args[nwords] = (uint32_t)(uintptr_t)&retval;
+		err = syscall_call(sd->sd_func, args, nwords + 1);
+		*retp = retval;
 		break;
-#ifdef UW
-	case SYS_write:
-	  err = sys_write((int)tf->tf_a0,
-			  (userptr_t)tf->tf_a1,
-			  (int)tf->tf_a2,
-			  (int *)(&retval));
-	  break;
-	case SYS__exit:
-	  sys__exit((int)tf->tf_a0);
-	  /* sys__exit does not return, execution should not get here */
-	  panic("unexpected return from sys__exit");
-	  break;
-	case SYS_getpid:
-	  err = sys_getpid((pid_t *)&retval);
-	  break;
-	case SYS_waitpid:
-	  err = sys_waitpid((pid_t)tf->tf_a0,
-			    (userptr_t)tf->tf_a1,
-			    (int)tf->tf_a2,
-			    (pid_t *)&retval);
-	  break;
-#endif // UW
 
-	    /* Add stuff here */
- 
-	default:
-	  kprintf("Unknown syscall %d\n", callno);
-	  err = ENOSYS;
-	  break;
+	    case SYSRET_OFF:
+		args[nwords] = (uint32_t)(uintptr_t)&retval64;
+		err = syscall_call(sd->sd_func, args, nwords + 1);
+		*retp = retval64;
+		break;
+
+	    default:
+		panic("syscall: bad descriptor for %s\n", sd->sd_name);
+	}
+	return err;
+}
+
+/*
+ * System call dispatcher.
+ *
+ * A pointer to the trapframe created during exception entry (in
+ * exception.S) is passed in.
+ *
+ * Upon syscall return the program counter stored in the trapframe
+ * must be incremented by one instruction; otherwise the exception
+ * return code will restart the "syscall" instruction and the system
+ * call will repeat forever.
+ */
+void
+syscall(struct trapframe *tf)
+{
+	const struct syscall_desc *sd;
+	uint32_t args[SYSCALL_MAXWORDS];
+	unsigned nwords;
+	int callno;
+	int64_t retval;
+	int err;
+#if OPT_SYSCALLSTAT
+	uint64_t start = 0;
+	bool timed;
+#endif
+
+	KASSERT(curthread != NULL);
+	KASSERT(curthread->t_curspl == 0);
+	KASSERT(curthread->t_iplhigh_count == 0);
+
+	callno = tf->tf_v0;
+
+#if OPT_SYSCALLSTAT
+	timed = syscallstat_enabled;
+	if (timed) {
+		start = syscallstat_now();
+	}
+#endif
+
+	retval = 0;
+
+	sd = syscall_lookup(callno);
+	if (sd == NULL) {
+		kprintf("Unknown syscall %d\n", callno);
+		err = ENOSYS;
+		goto done;
+	}
+
+	/* Collect the arguments. */
+	nwords = sd->sd_nargs;
+	KASSERT(nwords < SYSCALL_MAXWORDS);
+	if (sd->sd_flags & SYSARG_TRAPFRAME) {
+		KASSERT(nwords == 1);
+		args[0] = (uint32_t)(uintptr_t)tf;
+	}
+	else {
+		args[0] = tf->tf_a0;
+		args[1] = tf->tf_a1;
+		args[2] = tf->tf_a2;
+		args[3] = tf->tf_a3;
+		if (nwords > 4) {
+			err = copyin((const_userptr_t)(tf->tf_sp + 16),
+				     &args[4], (nwords - 4) * sizeof(args[0]));
+			if (err) {
+				goto done;
+			}
+		}
 	}
 
+	if ((sd->sd_flags & SYSRET_MASK) == SYSRET_NEVER) {
+		KASSERT(nwords == 1);
+		((void (*)(uint32_t))sd->sd_func)(args[0]);
+		panic("unexpected return from sys_%s\n", sd->sd_name);
+	}
+	err = syscall_invoke(sd, args, &retval);
+
+ done:
+#if OPT_SYSCALLSTAT
+	if (timed) {
+		syscallstat_record(callno, syscallstat_now() - start, err);
+	}
+#endif
 
 	if (err) {
 		/*
@@ -149,9 +375,15 @@ syscall(struct trapframe *tf)
 		tf->tf_v0 = err;
 		tf->tf_a3 = 1;      /* signal an error */
 	}
+	else if ((sd->sd_flags & SYSRET_MASK) == SYSRET_OFF) {
+		/* Success, 64-bit. */
+		tf->tf_v0 = (uint32_t)(retval >> 32);
+		tf->tf_v1 = (uint32_t)retval;
+		tf->tf_a3 = 0;      /* signal no error */
+	}
 	else {
 		/* Success. */
-		tf->tf_v0 = retval;
+		tf->tf_v0 = (int32_t)retval;
 		tf->tf_a3 = 0;      /* signal no error */
 	}
 	
@@ -171,13 +403,105 @@ syscall(struct trapframe *tf)
 /*
  * Enter user mode for a newly forked process.
  *
- * This function is provided as a reminder. You need to write
- * both it and the code that calls it.
- *
- * Thus, you can trash it and do things another way if you prefer.
+ * TF is the parent's trapframe from the fork call, copied onto the
+ * top of our own stack by thread_fork_frame; mips_usermode insists
+ * on that. Make fork return 0 in the child, and go.
  */
 void
 enter_forked_process(struct trapframe *tf)
 {
-	(void)tf;
+	tf->tf_v0 = 0;
+	tf->tf_a3 = 0;      /* signal no error */
+	tf->tf_epc += 4;
+
+	as_activate();
+	mips_usermode(tf);
+	panic("enter_forked_process: mips_usermode returned\n");
+}
+
+/*
+ * sysring_enter: run the pending entries of the sysring at URING,
+ * each through the same table as a trapped call, and return how many
+ * were run. The head index is written back even if we stop early on
+ * a fault, so entries that ran aren't run again.
+ */
+int
+sys_sysring_enter(userptr_t uring, int32_t *retval)
+{
+	struct sysring *ring = (struct sysring *)uring;
+	const struct syscall_desc *sd;
+	struct sysring_entry se;
+	uint32_t args[SYSCALL_MAXWORDS];
+	uint32_t head, tail;
+	unsigned i;
+	int64_t rv;
+	int err, result;
+#if OPT_SYSCALLSTAT
+	uint64_t start = 0;
+	bool timed;
+#endif
+
+	result = copyin((const_userptr_t)&ring->sr_head, &head, sizeof(head));
+	if (result) {
+		return result;
+	}
+	result = copyin((const_userptr_t)&ring->sr_tail, &tail, sizeof(tail));
+	if (result) {
+		return result;
+	}
+	if (tail - head > SYSRING_SIZE) {
+		return EINVAL;
+	}
+
+	*retval = 0;
+	while (head != tail) {
+		struct sysring_entry *ue;
+
+		ue = &ring->sr_entries[head % SYSRING_SIZE];
+		result = copyin((const_userptr_t)ue, &se, sizeof(se));
+		if (result) {
+			break;
+		}
+
+#if OPT_SYSCALLSTAT
+		timed = syscallstat_enabled;
+		if (timed) {
+			start = syscallstat_now();
+		}
+#endif
+		rv = 0;
+		sd = syscall_lookup(se.se_callno);
+		if (sd == NULL || (sd->sd_flags & SYSF_BATCH) == 0) {
+			err = ENOSYS;
+		}
+		else {
+			for (i=0; i<sd->sd_nargs; i++) {
+				args[i] = se.se_args[i];
+			}
+			err = syscall_invoke(sd, args, &rv);
+		}
+#if OPT_SYSCALLSTAT
+		if (timed) {
+			syscallstat_record(se.se_callno,
+					   syscallstat_now() - start, err);
+		}
+#endif
+
+		se.se_error = err;
+		se.se_retval = err ? 0 : rv;
+		/* se_error and se_retval are adjacent; copy out both. */
+		result = copyout(&se.se_error, (userptr_t)&ue->se_error,
+				 sizeof(se.se_error) + sizeof(se.se_retval));
+		if (result) {
+			break;
+		}
+		head++;
+		(*retval)++;
+	}
+
+	err = copyout(&head, (userptr_t)&ring->sr_head, sizeof(head));
+	if (result == 0) {
+		result = err;
+	}
+	return *retval > 0 ? 0 : result;
 }
@@ -52,7 +52,7 @@ extern void mips_threadstart(/* arguments are in unusual registers */);
  * (mips_threadstart) to move them and then jump to thread_startup.
  */
 void 
-switchframe_init(struct thread *thread,
+switchframe_init(struct thread *thread, size_t reserve,
 		 void (*entrypoint)(void *data1, unsigned long data2),
 		 void *data1, unsigned long data2)
 {
@@ -61,10 +61,10 @@ switchframe_init(struct thread *thread,
 
         /*
          * MIPS stacks grow down. t_stack is just a hunk of memory, so
-         * get the other end of it. Then set up a switchframe on the
-         * top of the stack.
+         * get the other end of it, less what the caller reserved.
+         * Then set up a switchframe on the top of the stack.
          */
-        stacktop = ((vaddr_t)thread->t_stack) + STACK_SIZE;
+        stacktop = ((vaddr_t)thread->t_stack) + STACK_SIZE - reserve;
         sf = ((struct switchframe *) stacktop) - 1;
 
         /* Zero out the switchframe. */
@@ -48,6 +48,19 @@
 /* under dumbvm, always have 48k of user stack */
 #define DUMBVM_STACKPAGES    12
 
+/*
+ * Stacks for additional user threads are 16k each, and go below the
+ * main stack, separated from it and each other by an unmapped page.
+ * Their memory is allocated the first time each slot is used and
+ * kept for reuse, since we can't free memory anyway.
+ */
+#define DUMBVM_THREADSTACKPAGES  4
+#define DUMBVM_THREADSTACKTOP(slot) \
+	(USERSTACK - (DUMBVM_STACKPAGES + 1 + \
+		      (slot) * (DUMBVM_THREADSTACKPAGES + 1)) * PAGE_SIZE)
+#define DUMBVM_THREADSTACKBASE(slot) \
+	(DUMBVM_THREADSTACKTOP(slot) - DUMBVM_THREADSTACKPAGES * PAGE_SIZE)
+
 /*
  * Wrap rma_stealmem in a spinlock.
  */
@@ -180,7 +193,21 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
 	else {
-		return EFAULT;
+		paddr = 0;
+		for (i=0; i<AS_THREADSTACKS; i++) {
+			stackbase = DUMBVM_THREADSTACKBASE(i);
+			stacktop = DUMBVM_THREADSTACKTOP(i);
+			if (as->as_threadstackpbase[i] != 0 &&
+			    faultaddress >= stackbase &&
+			    faultaddress < stacktop) {
+				paddr = (faultaddress - stackbase) +
+					as->as_threadstackpbase[i];
+				break;
+			}
+		}
+		if (paddr == 0) {
+			return EFAULT;
+		}
 	}
 
 	/* make sure it's page-aligned */
@@ -210,6 +237,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 struct addrspace *
 as_create(void)
 {
+	unsigned i;
 	struct addrspace *as = kmalloc(sizeof(struct addrspace));
 	if (as==NULL) {
 		return NULL;
@@ -222,6 +250,9 @@ as_create(void)
 	as->as_pbase2 = 0;
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
+	for (i=0; i<AS_THREADSTACKS; i++) {
+		as->as_threadstackpbase[i] = 0;
+	}
 
 	return as;
 }
@@ -353,10 +384,38 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+int
+as_define_threadstack(struct addrspace *as, unsigned slot, vaddr_t *stackptr)
+{
+	KASSERT(slot < AS_THREADSTACKS);
+
+	if (as->as_threadstackpbase[slot] == 0) {
+		as->as_threadstackpbase[slot] =
+			getppages(DUMBVM_THREADSTACKPAGES);
+		if (as->as_threadstackpbase[slot] == 0) {
+			return ENOMEM;
+		}
+	}
+	as_zero_region(as->as_threadstackpbase[slot],
+		       DUMBVM_THREADSTACKPAGES);
+
+	*stackptr = DUMBVM_THREADSTACKTOP(slot);
+	return 0;
+}
+
+void
+as_release_threadstack(struct addrspace *as, unsigned slot)
+{
+	/* Nothing; the memory stays with the slot. */
+	KASSERT(slot < AS_THREADSTACKS);
+	KASSERT(as->as_threadstackpbase[slot] != 0);
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
 	struct addrspace *new;
+	unsigned i;
 
 	new = as_create();
 	if (new==NULL) {
@@ -389,6 +448,23 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	memmove((void *)PADDR_TO_KVADDR(new->as_stackpbase),
 		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
 		DUMBVM_STACKPAGES*PAGE_SIZE);
+
+	/* Copy thread stacks too, in case the caller is on one. */
+	for (i=0; i<AS_THREADSTACKS; i++) {
+		if (old->as_threadstackpbase[i] == 0) {
+			continue;
+		}
+		new->as_threadstackpbase[i] =
+			getppages(DUMBVM_THREADSTACKPAGES);
+		if (new->as_threadstackpbase[i] == 0) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+		memmove((void *)PADDR_TO_KVADDR(new->as_threadstackpbase[i]),
+			(const void *)
+			PADDR_TO_KVADDR(old->as_threadstackpbase[i]),
+			DUMBVM_THREADSTACKPAGES*PAGE_SIZE);
+	}
 	
 	*ret = new;
 	return 0;
@@ -73,6 +73,66 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Read the on-chip cycle counter. ($9 == c0_count.)
+ */
+static
+uint32_t
+mips_timer_count(void)
+{
+	uint32_t count;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
+/*
+ * Restart the on-chip timer with c0_count at START, so the next
+ * interrupt comes when it reaches COUNT.
+ */
+static
+void
+mips_timer_restart(uint32_t start, uint32_t count)
+{
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mtc0 %0, $9;"		/* count = start */
+		"mtc0 %1, $11;"		/* compare = count */
+		".set pop"		/* restore assembler mode */
+		:: "r" (start), "r" (count));
+}
+
+/*
+ * Program the next hardclock for the MI tickless code. Since c0_count
+ * is restarted from zero each time, its value is the time since the
+ * last call. "Off" is approximated by the longest interval the timer
+ * can do, which is a few minutes; hardclock() ignores the interrupt
+ * if it does go off.
+ */
+unsigned
+mainbus_timer_set(unsigned hardclocks)
+{
+	const uint32_t period = CPU_FREQUENCY / HZ;
+	uint32_t now, carry;
+
+	now = mips_timer_count();
+	carry = now % period;
+
+	if (hardclocks == 0 || hardclocks > 0xffffffff / period) {
+		mips_timer_restart(carry, 0xffffffff);
+	}
+	else {
+		mips_timer_restart(carry, hardclocks * period);
+	}
+	return now / period;
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -268,9 +328,10 @@ mainbus_interrupt(struct trapframe *tf)
 		lamebus_clear_ipi(lamebus, curcpu);
 	}
 	else if (cause & MIPS_TIMER_BIT) {
-		/* Reset the timer (this clears the interrupt) */
-		mips_timer_set(CPU_FREQUENCY / HZ);
-		/* and call hardclock */
+		/*
+		 * Call hardclock. It resets the timer through
+		 * mainbus_timer_set, which clears the interrupt.
+		 */
 		hardclock();
 	}
 	else {
@@ -39,6 +39,9 @@
 
 struct vnode;
 
+/* Number of extra user stacks, for user-level threads. */
+#define AS_THREADSTACKS 16
+
 
 /* 
  * Address space - data structure associated with the virtual memory
@@ -55,6 +58,7 @@ struct addrspace {
   paddr_t as_pbase2;
   size_t as_npages2;
   paddr_t as_stackpbase;
+  paddr_t as_threadstackpbase[AS_THREADSTACKS];
 };
 
 /*
@@ -91,6 +95,15 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_define_threadstack - set up stack number SLOT (0 through
+ *                AS_THREADSTACKS-1) for an additional user-level
+ *                thread, and hand back its initial stack pointer.
+ *                The caller is responsible for not giving the same
+ *                slot to two threads at once.
+ *
+ *    as_release_threadstack - the thread using stack SLOT is done
+ *                with it.
  */
 
 struct addrspace *as_create(void);
@@ -107,6 +120,9 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_threadstack(struct addrspace *as, unsigned slot,
+                                        vaddr_t *initstackptr);
+void              as_release_threadstack(struct addrspace *as, unsigned slot);
 
 
 /*
@@ -36,10 +36,12 @@
  * Time-related definitions.
  *
  * hardclock() is called on every CPU HZ times a second, possibly only
- * when the CPU is not idle, for scheduling.
+ * when the CPU is not idle, for scheduling. hardclock_setperiod()
+ * changes how many 1/HZ periods go by between calls on the current
+ * CPU; 0 stops them. See "Tickless operation" in clock.c.
  *
  * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timed operations. For anything finer, use timeouts, below.
  *
  * gettime() may be used to fetch the current time of day.
  * getinterval() computes the time from time1 to time2.
@@ -59,6 +61,7 @@
 void hardclock_bootstrap(void);
 
 void hardclock(void);
+void hardclock_setperiod(unsigned hardclocks);
 void timerclock(void);
 
 void gettime(time_t *seconds, uint32_t *nanoseconds);
@@ -73,5 +76,30 @@ void getinterval(time_t secs1, uint32_t nsecs,
  */
 void clocksleep(int seconds);
 
+/*
+ * Timeouts: call a function (in interrupt context, on one CPU) after
+ * a given number of hardclocks. The struct timeout belongs to the
+ * caller and must stay put while the timeout is pending.
+ *
+ * timeout_init() sets up the function and argument.
+ * timeout_add() schedules (or reschedules) it TICKS hardclocks out.
+ * timeout_del() cancels it, returning false if it wasn't pending.
+ *
+ * timeout_sleep() suspends the current thread for TICKS hardclocks;
+ * it returns an error only if it can't allocate a wait channel.
+ */
+struct timeout {
+	struct timeout *to_next;	/* in wheel slot or pending list */
+	struct timeout **to_prevp;	/* NULL if not pending */
+	unsigned to_expires;		/* hardclock time to go off */
+	void (*to_func)(void *);	/* function to call */
+	void *to_data;			/* argument for to_func */
+};
+
+void timeout_init(struct timeout *to, void (*func)(void *), void *data);
+void timeout_add(struct timeout *to, unsigned ticks);
+bool timeout_del(struct timeout *to);
+int timeout_sleep(unsigned ticks);
+
 
 #endif /* _CLOCK_H_ */
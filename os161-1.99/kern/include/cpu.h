@@ -36,6 +36,12 @@
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
+/*
+ * Number of scheduling priority levels, and thus of run queues per
+ * cpu. Level 0 is the highest priority. See schedule() in thread.c.
+ */
+#define SCHED_NPRIO	4
+
 /*
  * Per-cpu structure
  *
@@ -59,15 +65,29 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
-	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	struct threadlist c_threadcache; /* Dead threads kept for reuse */
+	unsigned c_hardclocks;		/* Hardclock periods elapsed */
+	unsigned c_hardclock_period;	/* Hardclocks per timer interrupt */
+	uint32_t c_stealseed;		/* Random state for thread_steal */
+	unsigned c_wake_prev;		/* Wakeups placed on previous cpu */
+	unsigned c_wake_idle;		/* Wakeups moved to an idle cpu */
+	unsigned c_wake_waker;		/* Wakeups moved to the waker's cpu */
 
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the runqueue lock.
 	 */
 	bool c_isidle;			/* True if this cpu is idle */
-	struct threadlist c_runqueue;	/* Run queue for this cpu */
-	struct spinlock c_runqueue_lock;
+	struct threadlist c_runqueue[SCHED_NPRIO]; /* Run queues, by priority */
+	struct ticketlock c_runqueue_lock;
+	uint64_t c_minvruntime;		/* Low-water vruntime (fairsched) */
+
+	/*
+	 * Number of threads on c_runqueue. Updated with the runqueue
+	 * lock held, but read without it by other cpus looking for
+	 * work to steal, so to them it is only a hint.
+	 */
+	volatile unsigned c_runqueue_hint;
 
 	/*
 	 * Accessed by other cpus.
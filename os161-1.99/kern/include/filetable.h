@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _FILETABLE_H_
+#define _FILETABLE_H_
+
+/*
+ * Open files and per-process file tables.
+ *
+ * An openfile is what open() creates: a vnode, the access mode, and
+ * the file position. File descriptors are slots in a process's
+ * filetable pointing at openfiles. dup2 and fork make more slots
+ * point at the same openfile, so they share its position.
+ *
+ * Locking:
+ *
+ * of_lock protects the position. It is only needed when the openfile
+ * might be in use by more than one thread at once. That's impossible
+ * when there is only one reference to the openfile (of_refcount is
+ * 1) and the process has only one thread. Only that thread could add
+ * another reference, so it can skip the lock. Openfiles with no
+ * meaningful position (the console) are never locked.
+ *
+ * ft_lock protects the slots of a filetable against changes from
+ * other threads of the same process. In a single-threaded process
+ * nobody else can change them, so filetable_get reads the slot
+ * without taking ft_lock or a reference. Otherwise it takes a
+ * reference under ft_lock, so a close in another thread can't pull
+ * the openfile out from under the caller.
+ */
+
+#include <limits.h>
+#include <spinlock.h>
+
+struct vnode;
+struct lock;
+
+struct openfile {
+	struct vnode *of_vnode;		/* The file */
+	int of_accmode;			/* O_RDONLY, O_WRONLY, or O_RDWR */
+	bool of_append;			/* O_APPEND: writes go at the end */
+	bool of_seekable;		/* Has a position */
+	struct lock *of_lock;		/* Protects of_offset */
+	off_t of_offset;		/* The position */
+	struct spinlock of_reflock;	/* Protects of_refcount */
+	unsigned of_refcount;		/* Slots and holds pointing here */
+};
+
+struct filetable {
+	struct spinlock ft_lock;	/* Protects ft_files */
+	struct openfile *ft_files[OPEN_MAX];
+};
+
+/* Open PATH (which is modified) with FLAGS and MODE, as for open(). */
+int openfile_open(char *path, int flags, mode_t mode, struct openfile **ret);
+
+/* Add or drop a reference; the last one closes the file. */
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+/*
+ * Lock and unlock the position for a read, write, or seek. Returns
+ * whether it locked, to pass to openfile_unlockpos.
+ */
+bool openfile_lockpos(struct openfile *of);
+void openfile_unlockpos(struct openfile *of, bool locked);
+
+/* Create, destroy (closing everything), and copy (for fork) tables. */
+struct filetable *filetable_create(void);
+void filetable_destroy(struct filetable *ft);
+int filetable_copy(struct filetable *src, struct filetable **ret);
+
+/* Put OF in the lowest free slot of FT; the table takes over the ref. */
+int filetable_place(struct filetable *ft, struct openfile *of, int *fd);
+
+/*
+ * Replace slot FD of FT with OF (which may be NULL) and return what
+ * was there (which may also be NULL), or fail with EBADF if FD is out
+ * of range. The table takes over the caller's reference to OF, and
+ * hands over its reference to the old openfile.
+ */
+int filetable_replace(struct filetable *ft, int fd, struct openfile *of,
+		      struct openfile **oldret);
+
+/*
+ * Look up file descriptor FD of the current process for use during a
+ * system call, and let go of it afterwards. HELD says whether a
+ * reference was taken; pass it back to filetable_put.
+ */
+int filetable_get(int fd, struct openfile **ret, bool *held);
+void filetable_put(struct openfile *of, bool held);
+
+#endif /* _FILETABLE_H_ */
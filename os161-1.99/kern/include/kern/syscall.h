@@ -92,7 +92,7 @@
 //#define SYS_setrlimit  37
 //                              (process priority control)
 //#define SYS_getpriority 38
-//#define SYS_setpriority 39
+#define SYS_setpriority 39
 //                              (process groups, sessions, and job control)
 //#define SYS_getpgid    40
 //#define SYS_setpgid    41
@@ -109,13 +109,13 @@
 #define SYS_close        49
 #define SYS_read         50
 #define SYS_pread        51
-//#define SYS_readv      52
-//#define SYS_preadv     53
+#define SYS_readv        52
+#define SYS_preadv       53
 #define SYS_getdirentry  54
 #define SYS_write        55
 #define SYS_pwrite       56
-//#define SYS_writev     57
-//#define SYS_pwritev    58
+#define SYS_writev       57
+#define SYS_pwritev      58
 #define SYS_lseek        59
 #define SYS_flock        60
 #define SYS_ftruncate    61
@@ -196,6 +196,21 @@
 #define SYS_sync         118
 #define SYS_reboot       119
 //#define SYS___sysctl   120
+//                              (user-level synchronization)
+#define SYS_futex_wait   121
+#define SYS_futex_wake   122
+//                              (user-level threads)
+#define SYS___threadfork 123
+#define SYS_threadexit   124
+#define SYS_threadjoin   125
+//                              (process creation)
+#define SYS_spawn        126
+//                              (statistics)
+#define SYS_syscallstats 127
+//                              (batching)
+#define SYS_sysring_enter 128
+//                              (file copying)
+#define SYS_copyfile     129
 
 /*CALLEND*/
 
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _KERN_SYSRING_H_
+#define _KERN_SYSRING_H_
+
+/*
+ * Batched system calls, for sysring_enter().
+ *
+ * A sysring is a ring of system call requests in user memory. The
+ * program fills in entries at sr_tail and advances it; sysring_enter
+ * runs the entries from sr_head up to sr_tail in order, in a single
+ * trap, storing each one's results back into its entry, and advances
+ * sr_head past them. The program owns sr_tail and the entries from
+ * sr_tail up to sr_head + SYSRING_SIZE; the kernel owns the rest.
+ * Indexes run freely and are taken modulo SYSRING_SIZE.
+ *
+ * Each entry is a call number and its arguments, as 32-bit words in
+ * the positions the MIPS calling convention would put them in (so a
+ * 64-bit argument takes an aligned pair of words). Only calls that
+ * make sense to batch (read, write, lseek, and the like) are
+ * allowed; others fail with ENOSYS. A failed entry doesn't stop the
+ * ones after it.
+ */
+
+/* Number of entries in a ring; a power of 2. */
+#define SYSRING_SIZE		32
+
+/* Most argument words an entry can carry. */
+#define SYSRING_MAXARGS		6
+
+struct sysring_entry {
+	__i32 se_callno;			/* in: call number */
+	__u32 se_args[SYSRING_MAXARGS];		/* in: argument words */
+	__i32 se_error;				/* out: 0 or error code */
+	__i64 se_retval;			/* out: return value */
+};
+
+struct sysring {
+	__u32 sr_head;				/* next entry to run */
+	__u32 sr_tail;				/* next entry to fill */
+	struct sysring_entry sr_entries[SYSRING_SIZE];
+};
+
+#endif /* _KERN_SYSRING_H_ */
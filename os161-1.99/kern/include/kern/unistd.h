@@ -35,5 +35,10 @@
 #define STDOUT_FILENO 1      /* Standard output */
 #define STDERR_FILENO 2      /* Standard error */
 
+/* Constants for setpriority */
+#define PRIO_PROCESS  0      /* "who" is a process id (0 for self) */
+#define PRIO_MIN      (-20)  /* Highest priority */
+#define PRIO_MAX      19     /* Lowest priority */
+
 
 #endif /* _KERN_UNISTD_H_ */
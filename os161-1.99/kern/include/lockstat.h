@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics.
+ *
+ * With "options lockstat", spinlocks, locks and semaphores count, per
+ * lock: acquisitions, contended acquisitions, spin iterations, time
+ * spent asleep waiting, and the longest time held (not for
+ * semaphores, which aren't held by anyone). Counting is off until
+ * turned on with lockstat_enable(); the "ls" menu command does that
+ * and prints the results.
+ *
+ * The counters are kept in a table per CPU, so collecting them adds
+ * no locking and no shared cache lines; lockstat_report() adds up
+ * the tables. Locks are identified by address, and by name when
+ * they have one. Times are in nanoseconds from the ltimer clock.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+struct cpu;
+
+/* Kinds of lock */
+#define LOCKSTAT_SPINLOCK	0
+#define LOCKSTAT_LOCK		1
+#define LOCKSTAT_SEM		2
+
+/* True while collecting. Checked before calling any of the below. */
+extern volatile bool lockstat_enabled;
+
+/* Current time in nanoseconds, for wait and hold times. */
+uint64_t lockstat_now(void);
+
+/*
+ * Record that LOCK (of kind KIND, named NAME, or NULL) was acquired,
+ * after SPINS spin iterations and WAITNS nanoseconds asleep. Contended
+ * means either was nonzero.
+ */
+void lockstat_acquired(const void *lock, unsigned kind, const char *name,
+		       unsigned spins, uint64_t waitns);
+
+/* Record that LOCK was released after being held for HOLDNS. */
+void lockstat_released(const void *lock, unsigned kind, const char *name,
+		       uint64_t holdns);
+
+/* Set up the statistics table for a new CPU. */
+void lockstat_cpu_init(struct cpu *c);
+
+/* Control and reporting; see the "ls" menu command. */
+void lockstat_enable(bool on);
+void lockstat_clear(void);
+void lockstat_report(unsigned howmany);
+
+#endif /* OPT_LOCKSTAT */
+
+#endif /* _LOCKSTAT_H_ */
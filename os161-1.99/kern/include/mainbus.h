@@ -52,6 +52,17 @@ void mainbus_interrupt(struct trapframe *);
 /* XXX this interface is not adequately MI */
 size_t mainbus_ramsize(void);
 
+/*
+ * Arrange for the current cpu's next hardclock interrupt to come
+ * HARDCLOCKS periods of 1/HZ seconds from now, or turn the timer off
+ * if HARDCLOCKS is 0. This also clears a pending timer interrupt.
+ * Returns the number of whole periods that went by since the timer
+ * was last set; the part of a period left over carries into the new
+ * setting, so nothing is lost by resetting it. Interrupts should be
+ * off.
+ */
+unsigned mainbus_timer_set(unsigned hardclocks);
+
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
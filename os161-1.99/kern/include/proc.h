@@ -40,11 +40,39 @@
 #include <thread.h> /* required for struct threadarray */
 
 struct addrspace;
+struct filetable;
 struct vnode;
+struct wchan;
 #ifdef UW
 struct semaphore;
 #endif // UW
 
+/* Scheduling weight of a process at the default priority. */
+#define PROC_WEIGHT_DEFAULT 1024
+
+/*
+ * Process table size; a power of 2. A pid is a slot number plus a
+ * generation count times the table size, so a slot's pid changes
+ * each time the slot is reused. See proc.c.
+ */
+#define PROC_TABLESIZE 2048
+
+/* Maximum number of user-level threads besides the first one. */
+#define PROC_MAXUTHREADS 16
+
+/*
+ * Record of an additional user-level thread (see thread_syscalls.c).
+ * The thread id is the index in p_uthreads plus one; the first thread
+ * of a process is thread 0 and has no record. A record stays in use
+ * after its thread exits until it is joined.
+ */
+struct uthread {
+	bool ut_inuse;			/* Record allocated */
+	bool ut_exited;			/* Thread has exited */
+	struct thread *ut_thread;	/* Thread, once started */
+	int ut_exitcode;		/* Exit code, once exited */
+};
+
 /*
  * Process structure.
  */
@@ -53,20 +81,39 @@ struct proc {
 	struct spinlock p_lock;		/* Lock for this structure */
 	struct threadarray p_threads;	/* Threads in this process */
 
+	/*
+	 * Process table and family; protected by the process table
+	 * lock (see proc.c), not p_lock. Children are on the parent's
+	 * p_children list until they exit, and then on its p_zombies
+	 * list until waited for.
+	 */
+	pid_t p_pid;			/* Process id; 0 for kproc */
+	struct proc *p_parent;		/* NULL once orphaned */
+	struct proc *p_children;	/* Running children */
+	struct proc *p_zombies;		/* Exited, unwaited children */
+	struct proc *p_nextsib;		/* Next on parent's list */
+	struct proc **p_prevsib;	/* Link that points to us */
+	bool p_exited;			/* Has exited */
+	int p_exitstatus;		/* Wait status, once exited */
+	struct wchan *p_childwchan;	/* For waiting for children */
+	bool *p_vforkdone;		/* Set when done borrowing the
+					   parent's address space (vfork) */
+
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
 
+	/* Scheduling */
+	unsigned p_weight;		/* Share of the cpu (fairsched) */
+
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
+	struct filetable *p_filetable;	/* open files (see filetable.h) */
 
-#ifdef UW
-  /* a vnode to refer to the console device */
-  /* this is a quick-and-dirty way to get console writes working */
-  /* you will probably need to change this when implementing file-related
-     system calls, since each process will need to keep track of all files
-     it has opened, not just the console. */
-  struct vnode *console;                /* a vnode for the console device */
-#endif
+	/* User-level threads; protected by p_lock */
+	unsigned p_nuthreads;		/* Running user threads */
+	bool p_exiting;			/* Set when _exit is called */
+	struct wchan *p_uthreadwchan;	/* For threadjoin and _exit */
+	struct uthread p_uthreads[PROC_MAXUTHREADS];
 
 	/* add more material here as needed */
 };
@@ -85,9 +132,45 @@ void proc_bootstrap(void);
 /* Create a fresh process for use by runprogram(). */
 struct proc *proc_create_runprogram(const char *name);
 
+/*
+ * Error for proc_create_runprogram having failed: ENPROC if the
+ * process table is full, otherwise ENOMEM.
+ */
+int proc_create_error(void);
+
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
+/*
+ * Finish exiting a process with wait status STATUS: it becomes a
+ * zombie for its parent to wait for, or is destroyed if it has none.
+ * Its exited children are destroyed and its running ones orphaned.
+ */
+void proc_exit(struct proc *proc, int status);
+
+/*
+ * Wait for child PID of the current process (or any child, if PID is
+ * -1) to exit, and destroy it. Returns the pid and wait status via
+ * RETPID and RETSTATUS. With NOHANG, *RETPID is 0 if no child was
+ * ready.
+ */
+int proc_wait(pid_t pid, bool nohang, pid_t *retpid, int *retstatus);
+
+/*
+ * vfork support. The child of vfork runs in its parent's address
+ * space, while the parent waits in proc_vfork_wait for *DONE. The
+ * child calls proc_vfork_done when it no longer needs the address
+ * space, because it has exec'd or is exiting; this is a no-op for
+ * other processes. spawn uses the same handshake to wait for the
+ * child to load its program.
+ *
+ * Nothing interrupts the wait, so a sibling thread's _exit can't
+ * hurry it along; sys_vfork therefore only borrows the address space
+ * of single-threaded processes, and forks otherwise.
+ */
+void proc_vfork_wait(bool *done);
+void proc_vfork_done(struct proc *proc);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _SCHEDTRACE_H_
+#define _SCHEDTRACE_H_
+
+/*
+ * Scheduler event trace.
+ *
+ * With "options schedtrace", the scheduler logs context switches,
+ * wakeups, migrations, and idle periods into a ring buffer per CPU,
+ * each event stamped with the time from the ltimer clock. Logging is
+ * off until turned on with schedtrace_enable(); the "st" menu command
+ * does that, and dumps the rings or summarizes them: a histogram of
+ * run queue latency (time from being made runnable to being switched
+ * in) and the CPU time each thread got.
+ *
+ * Each ring is only written by its own CPU, with interrupts off, so
+ * logging takes no locks; when a ring fills, the oldest events are
+ * overwritten. Readers don't lock either, so turn logging off before
+ * dumping if an exact picture matters.
+ *
+ * Events can also be mirrored to trace161 through ltrace_debug(), so
+ * they line up with the simulator's own trace; see schedtrace.c for
+ * the encoding.
+ */
+
+#include "opt-schedtrace.h"
+
+#if OPT_SCHEDTRACE
+
+struct cpu;
+struct thread;
+
+/* Kinds of event */
+#define SCHEDTRACE_SWITCHOUT	0	/* thread stopped running */
+#define SCHEDTRACE_SWITCHIN	1	/* thread started running */
+#define SCHEDTRACE_WAKEUP	2	/* thread made runnable */
+#define SCHEDTRACE_MIGRATE	3	/* thread moved to this cpu */
+#define SCHEDTRACE_IDLE		4	/* cpu went idle */
+#define SCHEDTRACE_UNIDLE	5	/* cpu stopped idling */
+
+/* True while logging. Checked before calling any of the below. */
+extern volatile bool schedtrace_enabled;
+
+/*
+ * Hooks for thread.c. Call with interrupts off.
+ *
+ * schedtrace_switch: the current cpu is switching from CUR, which is
+ * going into state NEWSTATE, to NEXT.
+ * schedtrace_wakeup: THREAD was put on the run queue of cpu C.
+ * schedtrace_migrate: THREAD was taken from cpu FROM's run queue.
+ * schedtrace_idle: the current cpu is going idle (IDLE true) or just
+ * stopped.
+ */
+void schedtrace_switch(struct thread *cur, struct thread *next,
+		       unsigned newstate);
+void schedtrace_wakeup(struct thread *thread, struct cpu *c);
+void schedtrace_migrate(struct thread *thread, struct cpu *from);
+void schedtrace_idle(bool idle);
+
+/* Set up the ring for a new CPU. */
+void schedtrace_cpu_init(struct cpu *c);
+
+/* Control and reporting; see the "st" menu command. */
+void schedtrace_enable(bool on);
+void schedtrace_ltrace(bool on);
+void schedtrace_clear(void);
+void schedtrace_dump(unsigned howmany);
+void schedtrace_summary(void);
+
+#endif /* OPT_SCHEDTRACE */
+
+#endif /* _SCHEDTRACE_H_ */
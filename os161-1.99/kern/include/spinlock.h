@@ -36,6 +36,7 @@
  */
 
 #include <cdefs.h>
+#include "opt-lockstat.h"
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -57,12 +58,19 @@
 struct spinlock {
 	volatile spinlock_data_t lk_lock; /* The memory word where we spin. */
 	struct cpu *lk_holder;		/* CPU holding this lock. */
+#if OPT_LOCKSTAT
+	uint64_t lk_stattime;		/* When acquired, for lockstat. */
+#endif
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
+#if OPT_LOCKSTAT
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, 0 }
+#else
 #define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#endif
 
 /*
  * Spinlock functions.
@@ -84,5 +92,32 @@ void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
 
+/*
+ * Ticket spinlock.
+ *
+ * Same rules and same API as the basic spinlock, but waiters are
+ * served in the order they arrive: each takes a ticket with an atomic
+ * fetch-and-add and then waits (only reading, never writing) until
+ * the lock's "now serving" count reaches it. This is fair, and the
+ * only write to the lock word while it's held is the release. Use it
+ * for locks with a lot of CPUs fighting over them.
+ */
+struct ticketlock {
+	volatile spinlock_data_t tkl_next;	/* Next ticket to hand out. */
+	volatile spinlock_data_t tkl_serving;	/* Ticket holding the lock. */
+	struct cpu *tkl_holder;			/* CPU holding this lock. */
+};
+
+#define TICKETLOCK_INITIALIZER \
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL }
+
+void ticketlock_init(struct ticketlock *lk);
+void ticketlock_cleanup(struct ticketlock *lk);
+
+void ticketlock_acquire(struct ticketlock *lk);
+void ticketlock_release(struct ticketlock *lk);
+
+bool ticketlock_do_i_hold(struct ticketlock *lk);
+
 
 #endif /* _SPINLOCK_H_ */
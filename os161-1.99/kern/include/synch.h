@@ -37,6 +37,7 @@
 
 #include <spinlock.h>
 #include <opt-A1.h>
+#include "opt-lockstat.h"
 
 /*
  * Dijkstra-style semaphore.
@@ -74,6 +75,11 @@ void V(struct semaphore *);
  *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
+ *
+ * The lock is adaptive: a thread that finds it held spins for a while
+ * (up to lock_spinlimit tries) as long as the holder is running on
+ * another CPU, and sleeps otherwise. On release with sleepers the
+ * lock is handed directly to one of them rather than reopened.
  */
 struct lock {
 #if OPT_A1
@@ -81,7 +87,13 @@ struct lock {
     struct wchan *lk_wchan;
     struct spinlock lk_lock;
     volatile int lk_value;
-    struct thread* lk_curthread;
+    struct thread *volatile lk_curthread;
+    struct cpu *volatile lk_holdercpu;  /* CPU lk_curthread got it on */
+    unsigned lk_sleepers;               /* threads on lk_wchan */
+    bool lk_handoff;                    /* released to a sleeper */
+#if OPT_LOCKSTAT
+    uint64_t lk_stattime;               /* when acquired, for lockstat */
+#endif
 #else
     char *lk_name;
     // add what you need here
@@ -110,6 +122,11 @@ bool lock_do_i_hold(struct lock *);
 
 void lock_destroy(struct lock *);
 
+#if OPT_A1
+/* Spin iterations before sleeping on a held lock; 0 never spins. */
+extern unsigned lock_spinlimit;
+#endif
+
 
 /*
  * Condition variable.
@@ -155,4 +172,47 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers can hold the lock at once, or one writer.
+ * Writers have preference: once a writer is waiting, new readers wait
+ * behind it, so a steady stream of readers can't starve writers. When
+ * the last writer leaves, all waiting readers are let in together.
+ * Because of the writer preference, a thread that already holds the
+ * lock for reading must not try to get it for reading again.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct rwlock {
+    char *rwlock_name;
+    struct wchan *rwlock_rwchan;        /* readers wait here */
+    struct wchan *rwlock_wwchan;        /* writers wait here */
+    struct spinlock rwlock_lock;
+    unsigned rwlock_readers;            /* readers holding the lock */
+    unsigned rwlock_wwaiting;           /* writers waiting for it */
+    struct thread *rwlock_writer;       /* writer holding it, if any */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading.
+ *    rwlock_release_read  - Give up a read hold.
+ *    rwlock_acquire_write - Get the lock for writing (exclusively).
+ *    rwlock_release_write - Give up the write hold. Only the thread
+ *                           holding it may do this.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                           the lock for writing.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
@@ -39,17 +39,26 @@ struct trapframe; /* from <machine/trapframe.h> */
 
 void syscall(struct trapframe *tf);
 
+/* Name of a system call, or NULL; for statistics. */
+const char *syscall_name(int callno);
+
 /*
  * Support functions.
  */
 
-/* Helper for fork(). You write this. */
+/* Enter user mode in the child of fork(). Does not return. */
 void enter_forked_process(struct trapframe *tf);
 
 /* Enter user mode. Does not return. */
 void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 		       vaddr_t entrypoint);
 
+/* User-level thread support, in thread_syscalls.c. */
+void uthread_exit(int code);
+void uthread_exitothers(void);
+void uthread_exec(void);
+void uthread_checkexit(void);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -57,10 +66,36 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t user_req, userptr_t user_rem);
+int sys_futex_wait(userptr_t uaddr, int32_t expected);
+int sys_futex_wake(userptr_t uaddr, int n, int32_t *retval);
+int sys___threadfork(userptr_t start, userptr_t func, userptr_t arg,
+		     int32_t *retval);
+void sys_threadexit(int code);
+int sys_threadjoin(int tid, userptr_t code);
+int sys_setpriority(int which, int who, int prio);
+int sys_spawn(userptr_t path, userptr_t argv, pid_t *retval);
+int sys_execv(userptr_t path, userptr_t argv);
+int sys_syscallstats(int callno, userptr_t stats);
+int sys_sysring_enter(userptr_t ring, int32_t *retval);
 
 #ifdef UW
+int sys_open(userptr_t path, int flags, mode_t mode, int *retval);
+int sys_close(int fdesc);
+int sys_read(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
+int sys_lseek(int fdesc, off_t pos, int whence, off_t *retval);
+int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_readv(int fdesc, userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fdesc, userptr_t iov, int iovcnt, int *retval);
+int sys_preadv(int fdesc, userptr_t iov, int iovcnt, off_t offset,
+	       int *retval);
+int sys_pwritev(int fdesc, userptr_t iov, int iovcnt, off_t offset,
+		int *retval);
+int sys_copyfile(int fdin, int fdout, off_t offset, size_t len, int *retval);
 void sys__exit(int exitcode);
+int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 
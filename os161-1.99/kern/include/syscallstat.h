@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _SYSCALLSTAT_H_
+#define _SYSCALLSTAT_H_
+
+/*
+ * System call statistics.
+ *
+ * With "options syscallstat", the syscall dispatcher counts, per
+ * call number, completed calls, failed calls, total time, and a
+ * histogram of latencies (see <kern/syscallstat.h>). Calls that
+ * don't return (_exit, threadexit, a successful execv) aren't
+ * counted. Counting is off until turned on with syscallstat_enable();
+ * the "sc" menu command does that and prints the results, and the
+ * syscallstats() system call hands them to userlevel.
+ *
+ * As with lockstat, the counters are kept in a table per CPU so the
+ * dispatcher needs no locks; readers add up the tables. Times are in
+ * nanoseconds from the ltimer clock.
+ */
+
+#include "opt-syscallstat.h"
+
+#if OPT_SYSCALLSTAT
+
+struct cpu;
+struct syscallstats;
+
+/* Call numbers we keep statistics for are below this; keep it above
+   the highest one in <kern/syscall.h>. */
+#define SYSCALLSTAT_NCALLS	160
+
+/* True while collecting. Checked before calling any of the below. */
+extern volatile bool syscallstat_enabled;
+
+/* Current time in nanoseconds. */
+uint64_t syscallstat_now(void);
+
+/* Record a call to CALLNO that took NS nanoseconds and returned ERR. */
+void syscallstat_record(int callno, uint64_t ns, int err);
+
+/* Set up the statistics table for a new CPU. */
+void syscallstat_cpu_init(struct cpu *c);
+
+/* Add up the CPUs' statistics for CALLNO. */
+void syscallstat_get(int callno, struct syscallstats *ss);
+
+/* Control and reporting; see the "sc" menu command. */
+void syscallstat_enable(bool on);
+void syscallstat_clear(void);
+void syscallstat_report(void);
+int syscallstat_histogram(const char *name);
+
+#endif /* OPT_SYSCALLSTAT */
+
+#endif /* _SYSCALLSTAT_H_ */
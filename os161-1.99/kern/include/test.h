@@ -56,9 +56,12 @@ int queuetest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int timeouttest(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int lockpingpong(int, char **);
+int spinbench(int, char **);
 
 #ifdef UW
 /* Another thread and synchronization test */
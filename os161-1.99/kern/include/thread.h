@@ -84,6 +84,17 @@ struct thread {
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
 
+	/*
+	 * Scheduler fields. Protected by the run queue lock of t_cpu
+	 * while the thread is running or runnable.
+	 */
+	int t_priority;			/* Priority level (0 is highest) */
+	unsigned t_quantum;		/* Hardclocks left in time slice */
+	uint64_t t_vruntime;		/* Weighted run time (fairsched) */
+	bool t_vrelative;		/* t_vruntime not yet rebased (fairsched) */
+	uint64_t t_readytime;		/* When made runnable (schedtrace) */
+	uint64_t t_oncputime;		/* When switched in (schedtrace) */
+
 	/*
 	 * Interrupt state fields.
 	 *
@@ -144,6 +155,16 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Like thread_fork, but "data1" is a copy of "framelen" bytes at
+ * "frame", placed on the new thread's stack, and the thread starts
+ * on cpu "cpu", or if that's null, the least busy one. For fork().
+ */
+int thread_fork_frame(const char *name, struct proc *proc, struct cpu *cpu,
+                      void (*func)(void *, unsigned long),
+                      const void *frame, size_t framelen,
+                      unsigned long data2);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -157,6 +178,14 @@ void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Charge the current thread for TICKS hardclocks, and preempt it if
+ * its time slice is used up or a higher-priority thread is waiting.
+ * Also decides when the next hardclock is needed. Called from the
+ * timer interrupt.
+ */
+void thread_tick(unsigned ticks);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
@@ -168,5 +197,10 @@ void schedule(void);
  */
 void thread_consider_migration(void);
 
+/*
+ * Print counts of where woken threads were placed, per cpu.
+ */
+void thread_wakestats(void);
+
 
 #endif /* _THREAD_H_ */
@@ -69,8 +69,11 @@ void thread_machdep_cleanup(struct thread_machdep *tm);
 /* Assembler-level context switch. */
 void switchframe_switch(struct switchframe **prev, struct switchframe **next);
 
-/* Thread initialization */
-void switchframe_init(struct thread *,
+/*
+ * Thread initialization. RESERVE bytes at the top of the stack are
+ * left alone for the caller's use.
+ */
+void switchframe_init(struct thread *, size_t reserve,
 		      void (*entrypoint)(void *data1, unsigned long data2),
 		      void *data1, unsigned long data2);
 
@@ -43,12 +43,18 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/unistd.h>
+#include <limits.h>
+#include <lib.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <synch.h>
+#include <wchan.h>
+#include <filetable.h>
 #include <kern/fcntl.h>  
 
 /*
@@ -69,7 +75,179 @@ static struct semaphore *proc_count_mutex;
 struct semaphore *no_proc_sem;   
 #endif  // UW
 
+/*
+ * The process table, which maps pids to processes.
+ *
+ * Free slots are kept on a FIFO list, so allocating and freeing a pid
+ * is O(1), and a freed slot goes to the back of the line. A slot's
+ * pid is its index plus a generation count (starting at 1, so pids
+ * below PROC_TABLESIZE are never used) times PROC_TABLESIZE, and the
+ * generation goes up each time the slot is freed; so a pid isn't
+ * reused until its slot has come around (PID_MAX+1)/PROC_TABLESIZE-1
+ * times, which makes it much less likely that a stale pid names the
+ * wrong process.
+ *
+ * proctable_lock also protects the family links in struct proc
+ * (p_parent, the p_children and p_zombies lists, p_exited, and
+ * p_exitstatus).
+ */
+struct proctable_slot {
+	struct proc *ps_proc;		/* process, or NULL if free */
+	pid_t ps_pid;			/* pid of ps_proc, or next pid */
+	int ps_nextfree;		/* next free slot, or -1 */
+};
 
+static struct spinlock proctable_lock;
+static struct proctable_slot proctable[PROC_TABLESIZE];
+static int proctable_freehead, proctable_freetail;
+
+/*
+ * Set up the process table.
+ */
+static
+void
+proctable_bootstrap(void)
+{
+	int i;
+
+	KASSERT((PID_MAX + 1) % PROC_TABLESIZE == 0);
+	KASSERT(PROC_TABLESIZE >= PID_MIN);
+
+	spinlock_init(&proctable_lock);
+	for (i=0; i<PROC_TABLESIZE; i++) {
+		proctable[i].ps_proc = NULL;
+		proctable[i].ps_pid = PROC_TABLESIZE + i;
+		proctable[i].ps_nextfree = i + 1;
+	}
+	proctable[PROC_TABLESIZE - 1].ps_nextfree = -1;
+	proctable_freehead = 0;
+	proctable_freetail = PROC_TABLESIZE - 1;
+}
+
+/*
+ * Give PROC a pid. Call with proctable_lock held.
+ */
+static
+int
+proctable_alloc(struct proc *proc)
+{
+	int slot;
+
+	KASSERT(spinlock_do_i_hold(&proctable_lock));
+
+	slot = proctable_freehead;
+	if (slot < 0) {
+		return ENPROC;
+	}
+	proctable_freehead = proctable[slot].ps_nextfree;
+	if (proctable_freehead < 0) {
+		proctable_freetail = -1;
+	}
+	proctable[slot].ps_proc = proc;
+	proctable[slot].ps_nextfree = -1;
+	proc->p_pid = proctable[slot].ps_pid;
+	return 0;
+}
+
+/*
+ * Take back PROC's pid. Call with proctable_lock held.
+ */
+static
+void
+proctable_free(struct proc *proc)
+{
+	int slot;
+
+	KASSERT(spinlock_do_i_hold(&proctable_lock));
+
+	slot = proc->p_pid % PROC_TABLESIZE;
+	KASSERT(proctable[slot].ps_proc == proc);
+	proctable[slot].ps_proc = NULL;
+
+	/* Next generation. */
+	proctable[slot].ps_pid += PROC_TABLESIZE;
+	if (proctable[slot].ps_pid > PID_MAX) {
+		proctable[slot].ps_pid = PROC_TABLESIZE + slot;
+	}
+
+	if (proctable_freetail < 0) {
+		proctable_freehead = slot;
+	}
+	else {
+		proctable[proctable_freetail].ps_nextfree = slot;
+	}
+	proctable_freetail = slot;
+}
+
+/*
+ * Why proc_create_runprogram failed. Only a guess, since slots can
+ * be freed in the meantime, but it's just for reporting.
+ */
+int
+proc_create_error(void)
+{
+	bool full;
+
+	spinlock_acquire(&proctable_lock);
+	full = proctable_freehead < 0;
+	spinlock_release(&proctable_lock);
+	return full ? ENPROC : ENOMEM;
+}
+
+/*
+ * Find the process with pid PID, or return NULL. Call with
+ * proctable_lock held.
+ */
+static
+struct proc *
+proctable_lookup(pid_t pid)
+{
+	struct proc *proc;
+
+	KASSERT(spinlock_do_i_hold(&proctable_lock));
+
+	if (pid < PID_MIN || pid > PID_MAX) {
+		return NULL;
+	}
+	proc = proctable[pid % PROC_TABLESIZE].ps_proc;
+	if (proc == NULL || proc->p_pid != pid) {
+		return NULL;
+	}
+	return proc;
+}
+
+/*
+ * Put PROC on the family list LIST (a parent's p_children or
+ * p_zombies), or take it off whatever list it's on. Call with
+ * proctable_lock held.
+ */
+static
+void
+proc_link(struct proc **list, struct proc *proc)
+{
+	KASSERT(proc->p_prevsib == NULL);
+
+	proc->p_nextsib = *list;
+	if (proc->p_nextsib != NULL) {
+		proc->p_nextsib->p_prevsib = &proc->p_nextsib;
+	}
+	proc->p_prevsib = list;
+	*list = proc;
+}
+
+static
+void
+proc_unlink(struct proc *proc)
+{
+	KASSERT(proc->p_prevsib != NULL);
+
+	*proc->p_prevsib = proc->p_nextsib;
+	if (proc->p_nextsib != NULL) {
+		proc->p_nextsib->p_prevsib = proc->p_prevsib;
+	}
+	proc->p_nextsib = NULL;
+	proc->p_prevsib = NULL;
+}
 
 /*
  * Create a proc structure.
@@ -79,6 +257,7 @@ struct proc *
 proc_create(const char *name)
 {
 	struct proc *proc;
+	unsigned i;
 
 	proc = kmalloc(sizeof(*proc));
 	if (proc == NULL) {
@@ -89,19 +268,53 @@ proc_create(const char *name)
 		kfree(proc);
 		return NULL;
 	}
+	proc->p_uthreadwchan = wchan_create("uthread");
+	if (proc->p_uthreadwchan == NULL) {
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
+	proc->p_childwchan = wchan_create("waitpid");
+	if (proc->p_childwchan == NULL) {
+		wchan_destroy(proc->p_uthreadwchan);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
 
 	threadarray_init(&proc->p_threads);
 	spinlock_init(&proc->p_lock);
 
+	/* Process table fields; set up by proc_create_runprogram */
+	proc->p_pid = 0;
+	proc->p_parent = NULL;
+	proc->p_children = NULL;
+	proc->p_zombies = NULL;
+	proc->p_nextsib = NULL;
+	proc->p_prevsib = NULL;
+	proc->p_exited = false;
+	proc->p_exitstatus = 0;
+	proc->p_vforkdone = NULL;
+
 	/* VM fields */
 	proc->p_addrspace = NULL;
 
+	/* Scheduling fields */
+	proc->p_weight = PROC_WEIGHT_DEFAULT;
+
 	/* VFS fields */
 	proc->p_cwd = NULL;
-
-#ifdef UW
-	proc->console = NULL;
-#endif // UW
+	proc->p_filetable = NULL;
+
+	/* User threads */
+	proc->p_nuthreads = 0;
+	proc->p_exiting = false;
+	for (i=0; i<PROC_MAXUTHREADS; i++) {
+		proc->p_uthreads[i].ut_inuse = false;
+		proc->p_uthreads[i].ut_exited = false;
+		proc->p_uthreads[i].ut_thread = NULL;
+		proc->p_uthreads[i].ut_exitcode = 0;
+	}
 
 	return proc;
 }
@@ -127,14 +340,30 @@ proc_destroy(struct proc *proc)
 	/*
 	 * We don't take p_lock in here because we must have the only
 	 * reference to this structure. (Otherwise it would be
-	 * incorrect to destroy it.)
+	 * incorrect to destroy it.) Other processes can still find it
+	 * in the process table and on its parent's list, though, until
+	 * it's taken off them.
 	 */
+	if (proc->p_pid != 0) {
+		spinlock_acquire(&proctable_lock);
+		KASSERT(proc->p_children == NULL);
+		KASSERT(proc->p_zombies == NULL);
+		if (proc->p_prevsib != NULL) {
+			proc_unlink(proc);
+		}
+		proctable_free(proc);
+		spinlock_release(&proctable_lock);
+	}
 
 	/* VFS fields */
 	if (proc->p_cwd) {
 		VOP_DECREF(proc->p_cwd);
 		proc->p_cwd = NULL;
 	}
+	if (proc->p_filetable) {
+		filetable_destroy(proc->p_filetable);
+		proc->p_filetable = NULL;
+	}
 
 
 #ifndef UW  // in the UW version, space destruction occurs in sys_exit, not here
@@ -157,12 +386,8 @@ proc_destroy(struct proc *proc)
 	}
 #endif // UW
 
-#ifdef UW
-	if (proc->console) {
-	  vfs_close(proc->console);
-	}
-#endif // UW
-
+	wchan_destroy(proc->p_childwchan);
+	wchan_destroy(proc->p_uthreadwchan);
 	threadarray_cleanup(&proc->p_threads);
 	spinlock_cleanup(&proc->p_lock);
 
@@ -193,6 +418,7 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
+  proctable_bootstrap();
   kproc = proc_create("[kernel]");
   if (kproc == NULL) {
     panic("proc_create for kproc failed\n");
@@ -211,38 +437,60 @@ proc_bootstrap(void)
 }
 
 /*
- * Create a fresh proc for use by runprogram.
+ * Give a new process a file table with the console open on stdin,
+ * stdout, and stderr.
+ */
+static
+int
+proc_openconsole(struct proc *proc)
+{
+	static const int modes[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+	struct openfile *of;
+	char path[5];
+	int fd, slot, result;
+
+	proc->p_filetable = filetable_create();
+	if (proc->p_filetable == NULL) {
+		return ENOMEM;
+	}
+	for (fd = STDIN_FILENO; fd <= STDERR_FILENO; fd++) {
+		/* vfs_open scribbles on the path */
+		strcpy(path, "con:");
+		result = openfile_open(path, modes[fd], 0, &of);
+		if (result) {
+			return result;
+		}
+		result = filetable_place(proc->p_filetable, of, &slot);
+		KASSERT(result == 0 && slot == fd);
+	}
+	return 0;
+}
+
+/*
+ * Create a fresh proc for use by runprogram, or by fork.
  *
  * It will have no address space and will inherit the current
- * process's (that is, the kernel menu's) current directory.
+ * process's (that is, the kernel menu's, or the forking process's)
+ * current directory, and the forking process's open files.
  */
 struct proc *
 proc_create_runprogram(const char *name)
 {
 	struct proc *proc;
-	char *console_path;
+	int result;
 
 	proc = proc_create(name);
 	if (proc == NULL) {
 		return NULL;
 	}
 
-#ifdef UW
-	/* open the console - this should always succeed */
-	console_path = kstrdup("con:");
-	if (console_path == NULL) {
-	  panic("unable to copy console path name during process creation\n");
-	}
-	if (vfs_open(console_path,O_WRONLY,0,&(proc->console))) {
-	  panic("unable to open the console during process creation\n");
-	}
-	kfree(console_path);
-#endif // UW
-	  
 	/* VM fields */
 
 	proc->p_addrspace = NULL;
 
+	/* The thread that will run the program. */
+	proc->p_nuthreads = 1;
+
 	/* VFS fields */
 
 #ifdef UW
@@ -271,9 +519,220 @@ proc_create_runprogram(const char *name)
 	V(proc_count_mutex);
 #endif // UW
 
+	/*
+	 * Process table fields. Processes started from the kernel
+	 * menu have no parent; it waits for them with no_proc_sem.
+	 */
+	spinlock_acquire(&proctable_lock);
+	if (proctable_alloc(proc)) {
+		spinlock_release(&proctable_lock);
+		proc_destroy(proc);
+		return NULL;
+	}
+	if (curproc != kproc) {
+		proc->p_parent = curproc;
+		proc_link(&curproc->p_children, proc);
+	}
+	spinlock_release(&proctable_lock);
+
+	/*
+	 * Open files: a copy of the parent's table, sharing its
+	 * openfiles, or for processes started from the menu, the
+	 * console on stdin, stdout, and stderr.
+	 */
+	if (curproc->p_filetable != NULL) {
+		result = filetable_copy(curproc->p_filetable,
+					&proc->p_filetable);
+	}
+	else {
+		result = proc_openconsole(proc);
+	}
+	if (result) {
+		proc_destroy(proc);
+		return NULL;
+	}
+
 	return proc;
 }
 
+/*
+ * Finish off an exiting process. Its threads and address space must
+ * already be gone.
+ */
+void
+proc_exit(struct proc *proc, int status)
+{
+	struct proc *parent, *kid, *reap;
+
+	KASSERT(proc != kproc);
+	KASSERT(threadarray_num(&proc->p_threads) == 0);
+
+	/* Let go of things a zombie doesn't need. */
+	if (proc->p_cwd) {
+		VOP_DECREF(proc->p_cwd);
+		proc->p_cwd = NULL;
+	}
+	if (proc->p_filetable) {
+		filetable_destroy(proc->p_filetable);
+		proc->p_filetable = NULL;
+	}
+
+	spinlock_acquire(&proctable_lock);
+
+	/* Orphan our running children; they'll clean up after themselves. */
+	while ((kid = proc->p_children) != NULL) {
+		proc_unlink(kid);
+		kid->p_parent = NULL;
+	}
+
+	/* Take our zombies off the list to destroy below. */
+	reap = NULL;
+	while ((kid = proc->p_zombies) != NULL) {
+		proc_unlink(kid);
+		kid->p_parent = NULL;
+		kid->p_nextsib = reap;
+		reap = kid;
+	}
+
+	proc->p_exitstatus = status;
+	proc->p_exited = true;
+	parent = proc->p_parent;
+	if (parent != NULL) {
+		proc_unlink(proc);
+		proc_link(&parent->p_zombies, proc);
+		wchan_wakeall(parent->p_childwchan);
+	}
+	spinlock_release(&proctable_lock);
+
+	while (reap != NULL) {
+		kid = reap;
+		reap = kid->p_nextsib;
+		kid->p_nextsib = NULL;
+		proc_destroy(kid);
+	}
+
+	/* If nobody's going to wait for us, we're done. */
+	if (parent == NULL) {
+		proc_destroy(proc);
+	}
+}
+
+/*
+ * Wait for the child of vfork to be done with our address space. DONE
+ * is on the waiting thread's stack, so that the child might even be
+ * destroyed (by some other thread calling waitpid) by the time we
+ * wake up.
+ */
+void
+proc_vfork_wait(bool *done)
+{
+	struct proc *proc = curproc;
+
+	spinlock_acquire(&proctable_lock);
+	while (!*done) {
+		wchan_lock(proc->p_childwchan);
+		spinlock_release(&proctable_lock);
+		wchan_sleep(proc->p_childwchan);
+		spinlock_acquire(&proctable_lock);
+	}
+	spinlock_release(&proctable_lock);
+}
+
+/*
+ * Give the address space back to the parent that vfork'd PROC, if
+ * it did. The parent can't be gone: it's waiting for this.
+ */
+void
+proc_vfork_done(struct proc *proc)
+{
+	if (proc->p_vforkdone == NULL) {
+		return;
+	}
+
+	spinlock_acquire(&proctable_lock);
+	KASSERT(proc->p_parent != NULL);
+	*proc->p_vforkdone = true;
+	proc->p_vforkdone = NULL;
+	wchan_wakeall(proc->p_parent->p_childwchan);
+	spinlock_release(&proctable_lock);
+}
+
+/*
+ * Wait for a child of the current process to exit, and destroy it.
+ * This only looks at the child in question (or the first of the
+ * current process's zombies), never at other processes.
+ */
+int
+proc_wait(pid_t pid, bool nohang, pid_t *retpid, int *retstatus)
+{
+	struct proc *proc = curproc;
+	struct proc *kid;
+	int result;
+
+	if (pid != -1 && pid <= 0) {
+		/* No process groups */
+		return EINVAL;
+	}
+
+	result = 0;
+	spinlock_acquire(&proctable_lock);
+	while (1) {
+		if (pid == -1) {
+			kid = proc->p_zombies;
+			if (kid == NULL && proc->p_children == NULL) {
+				result = ECHILD;
+				break;
+			}
+		}
+		else {
+			kid = proctable_lookup(pid);
+			if (kid == NULL) {
+				result = ESRCH;
+				break;
+			}
+			if (kid->p_parent != proc) {
+				result = ECHILD;
+				break;
+			}
+			if (!kid->p_exited) {
+				kid = NULL;
+			}
+		}
+		if (kid != NULL) {
+			proc_unlink(kid);
+			kid->p_parent = NULL;
+			break;
+		}
+		if (nohang) {
+			break;
+		}
+
+		/* Check p_exiting with the channel locked; see uthread_exitothers */
+		wchan_lock(proc->p_childwchan);
+		if (proc->p_exiting) {
+			wchan_unlock(proc->p_childwchan);
+			result = EINTR;
+			break;
+		}
+		spinlock_release(&proctable_lock);
+		wchan_sleep(proc->p_childwchan);
+		spinlock_acquire(&proctable_lock);
+	}
+	spinlock_release(&proctable_lock);
+
+	if (result) {
+		return result;
+	}
+	if (kid == NULL) {
+		*retpid = 0;
+		return 0;
+	}
+	*retpid = kid->p_pid;
+	*retstatus = kid->p_exitstatus;
+	proc_destroy(kid);
+	return 0;
+}
+
 /*
  * Add a thread to a process. Either the thread or the process might
  * or might not be current.
@@ -42,9 +42,15 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockstat.h>
+#include <schedtrace.h>
+#include <syscallstat.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
+#include "opt-schedtrace.h"
+#include "opt-syscallstat.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -396,6 +402,129 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for wakeup placement stats.
+ */
+static
+int
+cmd_wakestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_wakestats();
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for lock statistics: "ls on", "ls off", "ls clear", or
+ * "ls [N]" to print the N (default 20) most contended locks.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs > 2) {
+		kprintf("Usage: ls [on | off | clear | count]\n");
+		return EINVAL;
+	}
+
+	if (nargs == 1) {
+		lockstat_report(20);
+	}
+	else if (!strcmp(args[1], "on")) {
+		lockstat_enable(true);
+	}
+	else if (!strcmp(args[1], "off")) {
+		lockstat_enable(false);
+	}
+	else if (!strcmp(args[1], "clear")) {
+		lockstat_clear();
+	}
+	else {
+		lockstat_report(atoi(args[1]));
+	}
+
+	return 0;
+}
+#endif
+
+#if OPT_SCHEDTRACE
+/*
+ * Command for the scheduler trace: "st on", "st off", "st clear",
+ * "st ltrace on|off" to mirror events to trace161, "st dump [N]" to
+ * print the last N (default 40) events, or just "st" for a summary.
+ */
+static
+int
+cmd_schedtrace(int nargs, char **args)
+{
+	if (nargs == 1) {
+		schedtrace_summary();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "on")) {
+		schedtrace_enable(true);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		schedtrace_enable(false);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "clear")) {
+		schedtrace_clear();
+	}
+	else if (nargs == 3 && !strcmp(args[1], "ltrace")) {
+		schedtrace_ltrace(!strcmp(args[2], "on"));
+	}
+	else if (nargs <= 3 && !strcmp(args[1], "dump")) {
+		schedtrace_dump(nargs == 3 && atoi(args[2]) > 0 ?
+				atoi(args[2]) : 40);
+	}
+	else {
+		kprintf("Usage: st [on | off | clear | ltrace on|off | "
+			"dump [count]]\n");
+		return EINVAL;
+	}
+
+	return 0;
+}
+#endif
+
+#if OPT_SYSCALLSTAT
+/*
+ * Command for system call statistics: "sc on", "sc off", "sc clear",
+ * "sc NAME" for the latency histogram of one call, or just "sc" for
+ * all calls made so far.
+ */
+static
+int
+cmd_syscallstat(int nargs, char **args)
+{
+	if (nargs > 2) {
+		kprintf("Usage: sc [on | off | clear | callname]\n");
+		return EINVAL;
+	}
+
+	if (nargs == 1) {
+		syscallstat_report();
+	}
+	else if (!strcmp(args[1], "on")) {
+		syscallstat_enable(true);
+	}
+	else if (!strcmp(args[1], "off")) {
+		syscallstat_enable(false);
+	}
+	else if (!strcmp(args[1], "clear")) {
+		syscallstat_clear();
+	}
+	else {
+		return syscallstat_histogram(args[1]);
+	}
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -435,6 +564,15 @@ static const char *opsmenu[] = {
 	"[cd]      Change directory          ",
 	"[pwd]     Print current directory   ",
 	"[sync]    Sync filesystems          ",
+#if OPT_LOCKSTAT
+	"[ls]      Lock contention stats     ",
+#endif
+#if OPT_SCHEDTRACE
+	"[st]      Scheduler trace           ",
+#endif
+#if OPT_SYSCALLSTAT
+	"[sc]      System call stats         ",
+#endif
 	"[panic]   Intentional panic         ",
 	"[q]       Quit and shut down        ",
 	NULL
@@ -459,12 +597,17 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[to]  Timeout test                  ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+#if OPT_A1
+	"[sy4] Lock ping-pong bench  (1)     ",
+#endif
+	"[sy5] Spinlock benchmark            ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -504,6 +647,7 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[ws] Wakeup placement stats         ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -559,6 +703,16 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "ws",		cmd_wakestats },
+#if OPT_LOCKSTAT
+	{ "ls",		cmd_lockstat },
+#endif
+#if OPT_SCHEDTRACE
+	{ "st",		cmd_schedtrace },
+#endif
+#if OPT_SYSCALLSTAT
+	{ "sc",		cmd_syscallstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -571,11 +725,16 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "to",		timeouttest },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+#if OPT_A1
+	{ "sy4",	lockpingpong },
+#endif
+	{ "sy5",	spinbench },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
@@ -0,0 +1,584 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/wait.h>
+#include <limits.h>
+#include <lib.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <vfs.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/*
+ * Starting programs: execv and spawn.
+ *
+ * The argument vector is copied into a kernel buffer laid out the
+ * way it will be on the new program's stack: the argv array (argc
+ * pointers and a NULL) followed by the strings. While in the kernel,
+ * the pointers hold offsets into the buffer; they're turned into user
+ * addresses, and the whole thing copied out, once the stack address
+ * is known. The total, pointers included, is limited to ARG_MAX.
+ *
+ * The buffer is made of ARGBUF_CHUNK-sized pieces, allocated as it
+ * grows. kmalloc serves anything under 2048 bytes from subpages;
+ * bigger takes whole pages, which dumbvm never gives back, and we do
+ * this on every spawn.
+ *
+ * Copying in goes a chunk-sized window at a time: each aligned
+ * window of user memory the argument vector touches is brought in
+ * with one copyin, and the pointers and strings are picked out of
+ * the copy. Arguments are usually packed together (on the caller's
+ * stack, or in one buffer), so this is far fewer copyins than one per
+ * pointer and one copyinstr per string. Windows divide pages evenly,
+ * so a window is either all there or not at all.
+ */
+
+#define ARGBUF_CHUNK	1024
+#define ARGBUF_NCHUNKS	(ARG_MAX / ARGBUF_CHUNK)
+
+struct argbuf {
+	char *ab_chunks[ARGBUF_NCHUNKS];/* pointers, then strings */
+	size_t ab_len;			/* bytes used */
+	int ab_argc;			/* number of arguments */
+};
+
+static
+void
+argbuf_init(struct argbuf *ab)
+{
+	unsigned i;
+
+	for (i=0; i<ARGBUF_NCHUNKS; i++) {
+		ab->ab_chunks[i] = NULL;
+	}
+	ab->ab_len = 0;
+	ab->ab_argc = 0;
+}
+
+static
+void
+argbuf_cleanup(struct argbuf *ab)
+{
+	unsigned i;
+
+	for (i=0; i<ARGBUF_NCHUNKS; i++) {
+		kfree(ab->ab_chunks[i]);
+		ab->ab_chunks[i] = NULL;
+	}
+}
+
+/*
+ * Store LEN bytes of DATA at offset POS, which the caller has checked
+ * is within ARG_MAX, allocating chunks as needed.
+ */
+static
+int
+argbuf_write(struct argbuf *ab, size_t pos, const void *data, size_t len)
+{
+	const char *src = data;
+	unsigned c;
+	size_t off, n;
+
+	KASSERT(pos + len <= ARG_MAX);
+	while (len > 0) {
+		c = pos / ARGBUF_CHUNK;
+		off = pos % ARGBUF_CHUNK;
+		if (ab->ab_chunks[c] == NULL) {
+			ab->ab_chunks[c] = kmalloc(ARGBUF_CHUNK);
+			if (ab->ab_chunks[c] == NULL) {
+				return ENOMEM;
+			}
+		}
+		n = ARGBUF_CHUNK - off;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(ab->ab_chunks[c] + off, src, n);
+		pos += n;
+		src += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * Pointer I of the argv array. Being aligned, none straddles chunks.
+ */
+static
+vaddr_t
+argbuf_getptr(struct argbuf *ab, int i)
+{
+	size_t pos = i * sizeof(vaddr_t);
+
+	return *(vaddr_t *)(ab->ab_chunks[pos / ARGBUF_CHUNK] +
+			    pos % ARGBUF_CHUNK);
+}
+
+static
+int
+argbuf_setptr(struct argbuf *ab, int i, vaddr_t val)
+{
+	return argbuf_write(ab, i * sizeof(vaddr_t), &val, sizeof(val));
+}
+
+/*
+ * Point *KP at the kernel copy of user address UADDR, and *AVAIL at
+ * how much of its window follows it, copying the window in if it
+ * isn't the one already in WINBUF (whose user address is *WINVA).
+ */
+static
+int
+argbuf_getwindow(char *winbuf, vaddr_t *winva, vaddr_t uaddr,
+		 const char **kp, size_t *avail)
+{
+	vaddr_t win;
+	int result;
+
+	win = uaddr & ~(vaddr_t)(ARGBUF_CHUNK - 1);
+	if (win != *winva) {
+		result = copyin((const_userptr_t)win, winbuf, ARGBUF_CHUNK);
+		if (result) {
+			*winva = 1;	/* not a window address; nothing cached */
+			return result;
+		}
+		*winva = win;
+	}
+	*kp = winbuf + (uaddr - win);
+	*avail = ARGBUF_CHUNK - (uaddr - win);
+	return 0;
+}
+
+/*
+ * Copy in the argument vector UARGV. On failure, AB is left empty.
+ */
+static
+int
+argbuf_copyin(userptr_t uargv, struct argbuf *ab)
+{
+	vaddr_t uaddr, winva;
+	const char *kp;
+	char *winbuf;
+	size_t pos, avail, len;
+	int argc, maxargc, i, result;
+	bool last;
+
+	argbuf_init(ab);
+
+	if ((vaddr_t)uargv % sizeof(vaddr_t) != 0) {
+		return EFAULT;
+	}
+
+	winbuf = kmalloc(ARGBUF_CHUNK);
+	if (winbuf == NULL) {
+		return ENOMEM;
+	}
+	winva = 1;
+
+	/*
+	 * The pointers first, a window at a time; hang onto the user
+	 * addresses for now. Being aligned, none straddles a window.
+	 */
+	maxargc = ARG_MAX / sizeof(vaddr_t) - 1;
+	argc = 0;
+	uaddr = (vaddr_t)uargv;
+	while (1) {
+		result = argbuf_getwindow(winbuf, &winva, uaddr, &kp, &avail);
+		if (result) {
+			goto fail;
+		}
+		for (; avail > 0; avail -= sizeof(vaddr_t)) {
+			if (*(const vaddr_t *)kp == 0) {
+				goto gotptrs;
+			}
+			if (argc == maxargc) {
+				result = E2BIG;
+				goto fail;
+			}
+			result = argbuf_setptr(ab, argc, *(const vaddr_t *)kp);
+			if (result) {
+				goto fail;
+			}
+			argc++;
+			kp += sizeof(vaddr_t);
+			uaddr += sizeof(vaddr_t);
+		}
+	}
+ gotptrs:
+	/* The NULL at the end; also makes sure the array has chunks. */
+	result = argbuf_setptr(ab, argc, 0);
+	if (result) {
+		goto fail;
+	}
+
+	/* Then the strings, each a piece per window it touches. */
+	pos = (argc + 1) * sizeof(vaddr_t);
+	for (i=0; i<argc; i++) {
+		uaddr = argbuf_getptr(ab, i);
+		result = argbuf_setptr(ab, i, pos);
+		if (result) {
+			goto fail;
+		}
+		do {
+			result = argbuf_getwindow(winbuf, &winva, uaddr,
+						  &kp, &avail);
+			if (result) {
+				goto fail;
+			}
+			for (len = 0; len < avail && kp[len] != 0; len++) {
+				/* nothing */
+			}
+			last = len < avail;
+			if (last) {
+				/* Found the end; take the null too. */
+				len++;
+			}
+			if (len > ARG_MAX - pos) {
+				result = E2BIG;
+				goto fail;
+			}
+			result = argbuf_write(ab, pos, kp, len);
+			if (result) {
+				goto fail;
+			}
+			pos += len;
+			uaddr += len;
+		} while (!last);
+	}
+
+	kfree(winbuf);
+	ab->ab_len = pos;
+	ab->ab_argc = argc;
+	return 0;
+
+ fail:
+	kfree(winbuf);
+	argbuf_cleanup(ab);
+	return result;
+}
+
+/*
+ * Put the arguments on the stack of the current address space, below
+ * *STACKPTR, with a copyout per chunk. Updates *STACKPTR and returns
+ * the user address of argv in *UARGV.
+ */
+static
+int
+argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr, userptr_t *uargv)
+{
+	vaddr_t base;
+	size_t pos, n;
+	int i, result;
+
+	/* Keep the stack 8-byte aligned. */
+	base = (*stackptr - ab->ab_len) & ~(vaddr_t)7;
+
+	for (i=0; i<ab->ab_argc; i++) {
+		result = argbuf_setptr(ab, i, argbuf_getptr(ab, i) + base);
+		KASSERT(result == 0);
+	}
+
+	for (pos = 0; pos < ab->ab_len; pos += n) {
+		n = ab->ab_len - pos;
+		if (n > ARGBUF_CHUNK) {
+			n = ARGBUF_CHUNK;
+		}
+		result = copyout(ab->ab_chunks[pos / ARGBUF_CHUNK],
+				 (userptr_t)(base + pos), n);
+		if (result) {
+			return result;
+		}
+	}
+
+	*stackptr = base;
+	*uargv = (userptr_t)base;
+	return 0;
+}
+
+/*
+ * execv: replace the current program with PATH, with arguments ARGV.
+ *
+ * Everything that can fail without harm (copying in the arguments,
+ * finding the program) is done before the point of no return, which
+ * is getting rid of the process's other threads, if any. After that,
+ * errors can still come from loading the program; then we go back to
+ * the old address space, and the caller carries on with one thread.
+ */
+int
+sys_execv(userptr_t path, userptr_t argv)
+{
+	struct proc *p = curproc;
+	struct argbuf args;
+	struct addrspace *as, *oldas;
+	struct vnode *v;
+	vaddr_t entrypoint, stackptr;
+	userptr_t uargv;
+	char *kpath, *name, *oldname;
+	int argc, result;
+
+	kpath = kmalloc(PATH_MAX);
+	if (kpath == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr(path, kpath, PATH_MAX, NULL);
+	if (result) {
+		kfree(kpath);
+		return result;
+	}
+	result = argbuf_copyin(argv, &args);
+	if (result) {
+		kfree(kpath);
+		return result;
+	}
+	/* vfs_open mangles the path, so take the new name first. */
+	name = kstrdup(kpath);
+	if (name == NULL) {
+		kfree(kpath);
+		argbuf_cleanup(&args);
+		return ENOMEM;
+	}
+	result = vfs_open(kpath, O_RDONLY, 0, &v);
+	kfree(kpath);
+	if (result) {
+		kfree(name);
+		argbuf_cleanup(&args);
+		return result;
+	}
+
+	uthread_exec();
+
+	as = as_create();
+	if (as == NULL) {
+		result = ENOMEM;
+		goto fail;
+	}
+	oldas = curproc_setas(as);
+	as_activate();
+
+	result = load_elf(v, &entrypoint);
+	if (result) {
+		goto failas;
+	}
+	result = as_define_stack(as, &stackptr);
+	if (result) {
+		goto failas;
+	}
+	result = argbuf_copyout(&args, &stackptr, &uargv);
+	if (result) {
+		goto failas;
+	}
+	argc = args.ab_argc;
+
+	vfs_close(v);
+	argbuf_cleanup(&args);
+
+	spinlock_acquire(&p->p_lock);
+	oldname = p->p_name;
+	p->p_name = name;
+	spinlock_release(&p->p_lock);
+	kfree(oldname);
+
+	/* The old address space might be our vfork parent's. */
+	if (p->p_vforkdone != NULL) {
+		proc_vfork_done(p);
+	}
+	else {
+		as_destroy(oldas);
+	}
+
+	enter_new_process(argc, uargv, stackptr, entrypoint);
+	panic("enter_new_process returned\n");
+
+ failas:
+	curproc_setas(oldas);
+	as_activate();
+	as_destroy(as);
+ fail:
+	vfs_close(v);
+	kfree(name);
+	argbuf_cleanup(&args);
+	return result;
+}
+
+/*
+ * The spawning thread and the new process's thread share this, on
+ * the spawning thread's stack, until the new process is loaded.
+ */
+struct spawnargs {
+	struct vnode *sa_vnode;		/* the program */
+	struct argbuf *sa_args;		/* its arguments */
+	int sa_result;			/* whether it loaded */
+};
+
+/*
+ * First thread of a process being spawned: load the program, and go.
+ * Tell the parent how that went, so it can return the error if any;
+ * the parent waits for this the same way it does for vfork (see
+ * proc_vfork_wait), and SA is no good after that.
+ */
+static
+void
+spawn_start(void *data1, unsigned long unused)
+{
+	struct spawnargs *sa = data1;
+	struct proc *p = curproc;
+	struct addrspace *as;
+	vaddr_t entrypoint, stackptr;
+	userptr_t uargv;
+	int argc, result;
+
+	(void)unused;
+
+	as = as_create();
+	if (as == NULL) {
+		result = ENOMEM;
+		goto fail;
+	}
+	curproc_setas(as);
+	as_activate();
+
+	result = load_elf(sa->sa_vnode, &entrypoint);
+	if (result) {
+		goto fail;
+	}
+	result = as_define_stack(as, &stackptr);
+	if (result) {
+		goto fail;
+	}
+	result = argbuf_copyout(sa->sa_args, &stackptr, &uargv);
+	if (result) {
+		goto fail;
+	}
+	argc = sa->sa_args->ab_argc;
+
+	sa->sa_result = 0;
+	proc_vfork_done(p);
+
+	enter_new_process(argc, uargv, stackptr, entrypoint);
+	panic("enter_new_process returned\n");
+
+ fail:
+	sa->sa_result = result;
+	proc_vfork_done(p);
+
+	/* The parent will reap us. */
+	as = curproc_setas(NULL);
+	if (as != NULL) {
+		as_deactivate();
+		as_destroy(as);
+	}
+	proc_remthread(curthread);
+	proc_exit(p, _MKWAIT_EXIT(255));
+	thread_exit();
+}
+
+/*
+ * spawn: run the program PATH with arguments ARGV in a new child
+ * process, like fork and execv together, but without copying the
+ * current address space only to throw it away. Errors in opening
+ * and loading the program are returned from here.
+ */
+int
+sys_spawn(userptr_t path, userptr_t argv, pid_t *retval)
+{
+	struct argbuf args;
+	struct spawnargs sa;
+	struct proc *child;
+	char *kpath;
+	pid_t pid;
+	int status, result;
+	bool done;
+
+	kpath = kmalloc(PATH_MAX);
+	if (kpath == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr(path, kpath, PATH_MAX, NULL);
+	if (result) {
+		kfree(kpath);
+		return result;
+	}
+	result = argbuf_copyin(argv, &args);
+	if (result) {
+		kfree(kpath);
+		return result;
+	}
+
+	/* Make the process before vfs_open mangles the path. */
+	child = proc_create_runprogram(kpath);
+	if (child == NULL) {
+		argbuf_cleanup(&args);
+		kfree(kpath);
+		return proc_create_error();
+	}
+	child->p_weight = curproc->p_weight;
+
+	result = vfs_open(kpath, O_RDONLY, 0, &sa.sa_vnode);
+	kfree(kpath);
+	if (result) {
+		proc_destroy(child);
+		argbuf_cleanup(&args);
+		return result;
+	}
+	sa.sa_args = &args;
+	sa.sa_result = 0;
+
+	done = false;
+	child->p_vforkdone = &done;
+	pid = child->p_pid;
+
+	/* Start on our cpu, which we're about to leave to wait. */
+	result = thread_fork(child->p_name, child, spawn_start, &sa, 0);
+	if (result) {
+		child->p_vforkdone = NULL;
+		proc_destroy(child);
+		vfs_close(sa.sa_vnode);
+		argbuf_cleanup(&args);
+		return result;
+	}
+
+	proc_vfork_wait(&done);
+	vfs_close(sa.sa_vnode);
+	argbuf_cleanup(&args);
+
+	if (sa.sa_result) {
+		/* Collect the remains. */
+		proc_wait(pid, false, &pid, &status);
+		return sa.sa_result;
+	}
+	*retval = pid;
+	return 0;
+}
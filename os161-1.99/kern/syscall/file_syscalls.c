@@ -1,60 +1,558 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
 #include <kern/unistd.h>
+#include <kern/iovec.h>
+#include <limits.h>
 #include <lib.h>
 #include <uio.h>
+#include <copyinout.h>
 #include <syscall.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <current.h>
 #include <proc.h>
+#include <filetable.h>
+
+/* iovec arrays up to this size are copied in on the stack */
+#define UIO_FASTIOV 8
+
+/*
+ * most iovecs copied in (and transferred) at once; more would take
+ * whole pages, which dumbvm never gives back
+ */
+#define UIO_CHUNKIOV 128
+
+/* most bytes one call can transfer; the count is returned as an int */
+#define FILE_IOMAX 0x7fffffff
+
+/*
+ * copyfile's bounce buffer. Allocations of 2048 bytes and up come
+ * from whole pages, which dumbvm never gives back, so stay within
+ * kmalloc's subpage sizes.
+ */
+#define COPYFILE_BUFSIZE 1024
+
+/*
+ * Look up file FDESC for reading or writing (according to RW), and
+ * check it was opened for that. Release it with filetable_put.
+ */
+static
+int
+file_get(int fdesc, enum uio_rw rw, struct openfile **ret, bool *held)
+{
+  struct openfile *of;
+  int res;
+
+  res = filetable_get(fdesc, &of, held);
+  if (res) {
+    return res;
+  }
+  if ((rw == UIO_READ && of->of_accmode == O_WRONLY) ||
+      (rw == UIO_WRITE && of->of_accmode == O_RDONLY)) {
+    filetable_put(of, *held);
+    return EBADF;
+  }
+  *ret = of;
+  return 0;
+}
+
+/*
+ * Where a write to OF at the current position starts: the position,
+ * or the end of the file with O_APPEND. Call with the position locked.
+ */
+static
+int
+file_writepos(struct openfile *of, off_t *ret)
+{
+  struct stat st;
+  int res;
+
+  if (of->of_append && of->of_seekable) {
+    res = VOP_STAT(of->of_vnode, &st);
+    if (res) {
+      return res;
+    }
+    *ret = st.st_size;
+  }
+  else {
+    *ret = of->of_offset;
+  }
+  return 0;
+}
+
+/*
+ * Common code for read and write and their vectored and positioned
+ * variants: transfer TOTAL bytes between file FDESC and the user
+ * buffers in IOV, in a single VOP_READ or VOP_WRITE however many
+ * buffers there are. If POSITIONED, do it at OFFSET, leaving the
+ * file's position alone; otherwise at and updating the position.
+ */
+static
+int
+file_io(int fdesc, struct iovec *iov, int iovcnt, size_t total,
+	bool positioned, off_t offset, enum uio_rw rw, int *retval)
+{
+  struct openfile *of;
+  struct uio u;
+  bool held, locked;
+  int res;
+
+  KASSERT(curproc->p_addrspace != NULL);
+
+  res = file_get(fdesc, rw, &of, &held);
+  if (res) {
+    return res;
+  }
+
+  locked = false;
+  if (positioned) {
+    if (offset < 0) {
+      res = EINVAL;
+      goto out;
+    }
+    if (!of->of_seekable) {
+      res = ESPIPE;
+      goto out;
+    }
+  }
+  else {
+    locked = openfile_lockpos(of);
+    if (rw == UIO_WRITE) {
+      res = file_writepos(of, &offset);
+      if (res) {
+	goto out;
+      }
+    }
+    else {
+      offset = of->of_offset;
+    }
+  }
+
+  /* set up a uio structure to refer to the user program's buffers */
+  u.uio_iov = iov;
+  u.uio_iovcnt = iovcnt;
+  u.uio_offset = offset;
+  u.uio_resid = total;
+  u.uio_segflg = UIO_USERSPACE;
+  u.uio_rw = rw;
+  u.uio_space = curproc->p_addrspace;
+
+  if (rw == UIO_READ) {
+    res = VOP_READ(of->of_vnode, &u);
+  }
+  else {
+    res = VOP_WRITE(of->of_vnode, &u);
+  }
+  if (res) {
+    goto out;
+  }
+
+  if (!positioned && of->of_seekable) {
+    of->of_offset = u.uio_offset;
+  }
+
+  /* pass back the number of bytes actually transferred */
+  *retval = total - u.uio_resid;
+  KASSERT(*retval >= 0);
+
+ out:
+  openfile_unlockpos(of, locked);
+  filetable_put(of, held);
+  return res;
+}
 
-/* handler for write() system call                  */
 /*
- * n.b.
- * This implementation handles only writes to standard output 
- * and standard error, both of which go to the console.
- * Also, it does not provide any synchronization, so writes
- * are not atomic.
+ * Copy in the user's iovec array UIOV and hand it to file_io.
  *
- * You will need to improve this implementation
+ * Arrays longer than UIO_CHUNKIOV are done that many buffers at a
+ * time, each chunk a separate file_io, stopping at the first short
+ * transfer; a failure after some data has moved reports what moved.
+ * The whole array is checked first, so nothing is transferred if the
+ * total is too big.
  */
+static
+int
+file_iov(int fdesc, userptr_t uiov, int iovcnt, bool positioned,
+	 off_t offset, enum uio_rw rw, int *retval)
+{
+  struct iovec fastiov[UIO_FASTIOV];
+  struct iovec *iov;
+  size_t total, chunk;
+  int max, i, j, n, done, got, res;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+    return EINVAL;
+  }
+  max = iovcnt < UIO_CHUNKIOV ? iovcnt : UIO_CHUNKIOV;
+  if (max <= UIO_FASTIOV) {
+    iov = fastiov;
+  }
+  else {
+    iov = kmalloc(max * sizeof(*iov));
+    if (iov == NULL) {
+      return ENOMEM;
+    }
+  }
+
+  /* the total has to fit in the return value */
+  total = 0;
+  for (i=0; i<iovcnt; i+=n) {
+    n = iovcnt - i < max ? iovcnt - i : max;
+    res = copyin((const_userptr_t)((vaddr_t)uiov + i * sizeof(*iov)),
+		 iov, n * sizeof(*iov));
+    if (res) {
+      goto out;
+    }
+    for (j=0; j<n; j++) {
+      if (iov[j].iov_len > FILE_IOMAX - total) {
+	res = EINVAL;
+	goto out;
+      }
+      total += iov[j].iov_len;
+    }
+  }
+
+  if (iovcnt == max) {
+    /* all in one go, and already copied in */
+    res = file_io(fdesc, iov, iovcnt, total, positioned, offset, rw,
+		  retval);
+    goto out;
+  }
+
+  done = 0;
+  for (i=0; i<iovcnt; i+=n) {
+    n = iovcnt - i < max ? iovcnt - i : max;
+    res = copyin((const_userptr_t)((vaddr_t)uiov + i * sizeof(*iov)),
+		 iov, n * sizeof(*iov));
+    if (res) {
+      break;
+    }
+    /* recheck; the array may have changed since */
+    chunk = 0;
+    for (j=0; j<n; j++) {
+      if (iov[j].iov_len > FILE_IOMAX - done - chunk) {
+	res = EINVAL;
+	break;
+      }
+      chunk += iov[j].iov_len;
+    }
+    if (res) {
+      break;
+    }
+    res = file_io(fdesc, iov, n, chunk, positioned, offset + done, rw, &got);
+    if (res) {
+      break;
+    }
+    done += got;
+    if ((size_t)got < chunk) {
+      break;
+    }
+  }
+  if (res && done > 0) {
+    res = 0;
+  }
+  if (res == 0) {
+    *retval = done;
+  }
 
+ out:
+  if (iov != fastiov) {
+    kfree(iov);
+  }
+  return res;
+}
+
+/* handler for open() system call                   */
+int
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
+{
+  struct openfile *of;
+  char *path;
+  int res;
+
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  res = copyinstr(upath, path, PATH_MAX, NULL);
+  if (res) {
+    kfree(path);
+    return res;
+  }
+  DEBUG(DB_SYSCALL,"Syscall: open(%s,%x)\n",path,flags);
+
+  res = openfile_open(path, flags, mode, &of);
+  kfree(path);
+  if (res) {
+    return res;
+  }
+
+  res = filetable_place(curproc->p_filetable, of, retval);
+  if (res) {
+    openfile_decref(of);
+  }
+  return res;
+}
+
+/* handler for close() system call                  */
+int
+sys_close(int fdesc)
+{
+  struct openfile *of;
+  int res;
+
+  res = filetable_replace(curproc->p_filetable, fdesc, NULL, &of);
+  if (res) {
+    return res;
+  }
+  if (of == NULL) {
+    return EBADF;
+  }
+  openfile_decref(of);
+  return 0;
+}
+
+/* handler for read() system call                   */
+int
+sys_read(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  struct iovec iov;
+
+  if (nbytes > FILE_IOMAX) {
+    return EINVAL;
+  }
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_io(fdesc, &iov, 1, nbytes, false, 0, UIO_READ, retval);
+}
+
+/* handler for write() system call                  */
 int
 sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
 {
   struct iovec iov;
-  struct uio u;
-  int res;
 
   DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
-  
-  /* only stdout and stderr writes are currently implemented */
-  if (!((fdesc==STDOUT_FILENO)||(fdesc==STDERR_FILENO))) {
-    return EUNIMP;
-  }
-  KASSERT(curproc != NULL);
-  KASSERT(curproc->console != NULL);
-  KASSERT(curproc->p_addrspace != NULL);
 
-  /* set up a uio structure to refer to the user program's buffer (ubuf) */
+  if (nbytes > FILE_IOMAX) {
+    return EINVAL;
+  }
   iov.iov_ubase = ubuf;
   iov.iov_len = nbytes;
-  u.uio_iov = &iov;
-  u.uio_iovcnt = 1;
-  u.uio_offset = 0;  /* not needed for the console */
-  u.uio_resid = nbytes;
-  u.uio_segflg = UIO_USERSPACE;
-  u.uio_rw = UIO_WRITE;
-  u.uio_space = curproc->p_addrspace;
+  return file_io(fdesc, &iov, 1, nbytes, false, 0, UIO_WRITE, retval);
+}
 
-  res = VOP_WRITE(curproc->console,&u);
+/* handler for lseek() system call                  */
+int
+sys_lseek(int fdesc, off_t pos, int whence, off_t *retval)
+{
+  struct openfile *of;
+  struct stat st;
+  off_t newpos;
+  bool held, locked;
+  int res;
+
+  res = filetable_get(fdesc, &of, &held);
   if (res) {
     return res;
   }
+  if (!of->of_seekable) {
+    filetable_put(of, held);
+    return ESPIPE;
+  }
 
-  /* pass back the number of bytes actually written */
-  *retval = nbytes - u.uio_resid;
-  KASSERT(*retval >= 0);
+  locked = openfile_lockpos(of);
+  newpos = 0;
+  switch (whence) {
+  case SEEK_SET:
+    newpos = pos;
+    break;
+  case SEEK_CUR:
+    newpos = of->of_offset + pos;
+    break;
+  case SEEK_END:
+    res = VOP_STAT(of->of_vnode, &st);
+    newpos = st.st_size + pos;
+    break;
+  default:
+    res = EINVAL;
+    break;
+  }
+  if (res == 0 && newpos < 0) {
+    res = EINVAL;
+  }
+  if (res == 0) {
+    res = VOP_TRYSEEK(of->of_vnode, newpos);
+  }
+  if (res == 0) {
+    of->of_offset = newpos;
+    *retval = newpos;
+  }
+  openfile_unlockpos(of, locked);
+
+  filetable_put(of, held);
+  return res;
+}
+
+/* handler for dup2() system call                   */
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+  struct openfile *of, *old;
+  bool held;
+  int res;
+
+  if (newfd < 0 || newfd >= OPEN_MAX) {
+    return EBADF;
+  }
+  res = filetable_get(oldfd, &of, &held);
+  if (res) {
+    return res;
+  }
+  if (oldfd != newfd) {
+    /* the new slot's reference; the two share the position */
+    openfile_incref(of);
+    res = filetable_replace(curproc->p_filetable, newfd, of, &old);
+    KASSERT(res == 0);
+    if (old != NULL) {
+      openfile_decref(old);
+    }
+  }
+  filetable_put(of, held);
+
+  *retval = newfd;
+  return 0;
+}
+
+/* handlers for readv(), writev(), preadv(), and pwritev() */
+int
+sys_readv(int fdesc, userptr_t iov, int iovcnt, int *retval)
+{
+  return file_iov(fdesc, iov, iovcnt, false, 0, UIO_READ, retval);
+}
+
+int
+sys_writev(int fdesc, userptr_t iov, int iovcnt, int *retval)
+{
+  return file_iov(fdesc, iov, iovcnt, false, 0, UIO_WRITE, retval);
+}
+
+int
+sys_preadv(int fdesc, userptr_t iov, int iovcnt, off_t offset, int *retval)
+{
+  return file_iov(fdesc, iov, iovcnt, true, offset, UIO_READ, retval);
+}
+
+int
+sys_pwritev(int fdesc, userptr_t iov, int iovcnt, off_t offset, int *retval)
+{
+  return file_iov(fdesc, iov, iovcnt, true, offset, UIO_WRITE, retval);
+}
+
+/*
+ * handler for copyfile() system call
+ *
+ * Copy up to LEN bytes from file FDIN, starting at OFFSET, to file
+ * FDOUT at its position (which moves past them), through a kernel
+ * buffer so the data never goes up to user level and back. FDIN's
+ * position is neither used nor changed. Stops early at end of file
+ * on FDIN. Returns the number of bytes copied; if an error happens
+ * after some have been, the count is returned and the error is left
+ * for the next call.
+ */
+int
+sys_copyfile(int fdin, int fdout, off_t offset, size_t len, int *retval)
+{
+  struct openfile *ofin, *ofout;
+  struct iovec iov;
+  struct uio ku;
+  char *buf;
+  size_t done, chunk, got, put;
+  off_t outpos;
+  bool heldin, heldout, locked;
+  int res;
+
+  DEBUG(DB_SYSCALL,"Syscall: copyfile(%d,%d,%lld,%u)\n",fdin,fdout,offset,len);
+
+  if (offset < 0) {
+    return EINVAL;
+  }
+  if (len > FILE_IOMAX) {
+    len = FILE_IOMAX;
+  }
+
+  res = file_get(fdin, UIO_READ, &ofin, &heldin);
+  if (res) {
+    return res;
+  }
+  res = file_get(fdout, UIO_WRITE, &ofout, &heldout);
+  if (res) {
+    filetable_put(ofin, heldin);
+    return res;
+  }
+  if (!ofin->of_seekable) {
+    filetable_put(ofout, heldout);
+    filetable_put(ofin, heldin);
+    return ESPIPE;
+  }
+
+  buf = kmalloc(COPYFILE_BUFSIZE);
+  if (buf == NULL) {
+    filetable_put(ofout, heldout);
+    filetable_put(ofin, heldin);
+    return ENOMEM;
+  }
+
+  /* the input side is positioned, so only the output needs locking */
+  locked = openfile_lockpos(ofout);
+  res = file_writepos(ofout, &outpos);
+
+  done = 0;
+  while (res == 0 && done < len) {
+    chunk = len - done;
+    if (chunk > COPYFILE_BUFSIZE) {
+      chunk = COPYFILE_BUFSIZE;
+    }
+
+    uio_kinit(&iov, &ku, buf, chunk, offset + done, UIO_READ);
+    res = VOP_READ(ofin->of_vnode, &ku);
+    if (res) {
+      break;
+    }
+    got = chunk - ku.uio_resid;
+    if (got == 0) {
+      /* end of file */
+      break;
+    }
+
+    uio_kinit(&iov, &ku, buf, got, outpos, UIO_WRITE);
+    res = VOP_WRITE(ofout->of_vnode, &ku);
+    if (res) {
+      break;
+    }
+    put = got - ku.uio_resid;
+    done += put;
+    outpos += put;
+    if (put < got) {
+      /* short write, e.g. the disk is full */
+      break;
+    }
+  }
+
+  if (done > 0 && ofout->of_seekable) {
+    ofout->of_offset = outpos;
+  }
+  openfile_unlockpos(ofout, locked);
+
+  kfree(buf);
+  filetable_put(ofout, heldout);
+  filetable_put(ofin, heldin);
+  if (res && done == 0) {
+    return res;
+  }
+  *retval = done;
   return 0;
 }
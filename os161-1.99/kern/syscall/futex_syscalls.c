@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <futex.h>
+
+/*
+ * Futex system calls.
+ *
+ * Each futex (one per user word that currently has waiters) has its
+ * own wait channel, and lives on a chain in one of FUTEX_HASHSIZE
+ * buckets. The bucket's spinlock protects the chain and the counts in
+ * the futexes on it.
+ *
+ * The waiter can't hold a spinlock while it reads the user word,
+ * since copyin can fault, so checking the word and going to sleep
+ * can't be done atomically with respect to futex_wake. Instead each
+ * futex has a wakeup sequence number: a waiter registers itself and
+ * notes the sequence number, reads the word, and then sleeps only if
+ * no wakeup has happened in between. If one has, the waiter just
+ * returns; it might have been the one meant to be woken. Either way
+ * the caller rechecks the word, so an occasional spurious return is
+ * harmless.
+ */
+
+#define FUTEX_HASHSIZE	64
+
+struct futex {
+	struct futex *f_next;		/* Next on hash chain */
+	struct addrspace *f_as;		/* Key: address space */
+	vaddr_t f_addr;			/* Key: user address */
+	struct wchan *f_wchan;		/* Sleeping threads */
+	unsigned f_refs;		/* Threads in futex_wait */
+	unsigned f_seq;			/* Count of wakeups */
+};
+
+struct futex_bucket {
+	struct spinlock fb_lock;
+	struct futex *fb_chain;
+};
+
+static struct futex_bucket futex_table[FUTEX_HASHSIZE];
+
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		spinlock_init(&futex_table[i].fb_lock);
+		futex_table[i].fb_chain = NULL;
+	}
+}
+
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, vaddr_t addr)
+{
+	uint32_t h;
+
+	/* Words are aligned; mix in the address space too. */
+	h = (addr >> 2) ^ ((uintptr_t)as >> 4);
+	h ^= h >> 11;
+	h *= 0x9e3779b1;
+	return &futex_table[h >> 26];
+}
+
+/*
+ * Find the futex for (AS, ADDR) in FB. Call with the bucket locked.
+ */
+static
+struct futex *
+futex_lookup(struct futex_bucket *fb, struct addrspace *as, vaddr_t addr)
+{
+	struct futex *f;
+
+	KASSERT(spinlock_do_i_hold(&fb->fb_lock));
+	for (f = fb->fb_chain; f != NULL; f = f->f_next) {
+		if (f->f_as == as && f->f_addr == addr) {
+			return f;
+		}
+	}
+	return NULL;
+}
+
+static
+struct futex *
+futex_create(struct addrspace *as, vaddr_t addr)
+{
+	struct futex *f;
+
+	f = kmalloc(sizeof(*f));
+	if (f == NULL) {
+		return NULL;
+	}
+	f->f_wchan = wchan_create("futex");
+	if (f->f_wchan == NULL) {
+		kfree(f);
+		return NULL;
+	}
+	f->f_next = NULL;
+	f->f_as = as;
+	f->f_addr = addr;
+	f->f_refs = 0;
+	f->f_seq = 0;
+	return f;
+}
+
+static
+void
+futex_destroy(struct futex *f)
+{
+	KASSERT(f->f_refs == 0);
+	wchan_destroy(f->f_wchan);
+	kfree(f);
+}
+
+void
+futex_wakeall(struct addrspace *as)
+{
+	struct futex_bucket *fb;
+	struct futex *f;
+	unsigned i;
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		fb = &futex_table[i];
+		spinlock_acquire(&fb->fb_lock);
+		for (f = fb->fb_chain; f != NULL; f = f->f_next) {
+			if (f->f_as == as) {
+				f->f_seq++;
+				wchan_wakeall(f->f_wchan);
+			}
+		}
+		spinlock_release(&fb->fb_lock);
+	}
+}
+
+/*
+ * Common checks on a user futex address.
+ */
+static
+int
+futex_checkaddr(userptr_t uaddr, struct addrspace **ret)
+{
+	if (uaddr == NULL) {
+		return EFAULT;
+	}
+	if ((vaddr_t)uaddr % sizeof(int32_t) != 0) {
+		return EINVAL;
+	}
+	*ret = curproc_getas();
+	if (*ret == NULL) {
+		return EFAULT;
+	}
+	return 0;
+}
+
+/*
+ * Sleep if the word at UADDR contains EXPECTED, until woken by
+ * futex_wake. Fails with EAGAIN if it doesn't. May also return early
+ * without having been woken explicitly.
+ */
+int
+sys_futex_wait(userptr_t uaddr, int32_t expected)
+{
+	struct addrspace *as;
+	struct futex_bucket *fb;
+	struct futex *f, *newf;
+	vaddr_t addr;
+	unsigned seq;
+	int32_t val;
+	int result;
+
+	result = futex_checkaddr(uaddr, &as);
+	if (result) {
+		return result;
+	}
+	addr = (vaddr_t)uaddr;
+	fb = futex_hash(as, addr);
+
+	/* Register, creating the futex if we're the first waiter. */
+	newf = NULL;
+	spinlock_acquire(&fb->fb_lock);
+	while ((f = futex_lookup(fb, as, addr)) == NULL && newf == NULL) {
+		spinlock_release(&fb->fb_lock);
+		newf = futex_create(as, addr);
+		if (newf == NULL) {
+			return ENOMEM;
+		}
+		spinlock_acquire(&fb->fb_lock);
+	}
+	if (f == NULL) {
+		f = newf;
+		newf = NULL;
+		f->f_next = fb->fb_chain;
+		fb->fb_chain = f;
+	}
+	f->f_refs++;
+	seq = f->f_seq;
+	spinlock_release(&fb->fb_lock);
+
+	if (newf != NULL) {
+		/* Someone else got there first. */
+		futex_destroy(newf);
+	}
+
+	result = copyin(uaddr, &val, sizeof(val));
+
+	/*
+	 * If the process started exiting before we registered,
+	 * futex_wakeall may have missed us; don't go to sleep.
+	 * (Otherwise it will bump f_seq or wake us.)
+	 */
+	spinlock_acquire(&curproc->p_lock);
+	if (result == 0 && curproc->p_exiting) {
+		result = EINTR;
+	}
+	spinlock_release(&curproc->p_lock);
+
+	spinlock_acquire(&fb->fb_lock);
+	if (result == 0 && val != expected) {
+		result = EAGAIN;
+	}
+	else if (result == 0 && f->f_seq == seq) {
+		/*
+		 * Lock the channel before unlocking the bucket, so
+		 * futex_wake can't get in between.
+		 */
+		wchan_lock(f->f_wchan);
+		spinlock_release(&fb->fb_lock);
+		wchan_sleep(f->f_wchan);
+		spinlock_acquire(&fb->fb_lock);
+	}
+
+	/* Unregister, and remove the futex if we were the last. */
+	KASSERT(f->f_refs > 0);
+	f->f_refs--;
+	if (f->f_refs == 0) {
+		struct futex **fp;
+
+		for (fp = &fb->fb_chain; *fp != f; fp = &(*fp)->f_next) {
+			KASSERT(*fp != NULL);
+		}
+		*fp = f->f_next;
+	}
+	else {
+		f = NULL;
+	}
+	spinlock_release(&fb->fb_lock);
+
+	if (f != NULL) {
+		futex_destroy(f);
+	}
+	return result;
+}
+
+/*
+ * Wake up to N threads sleeping in futex_wait on UADDR. Returns the
+ * number actually woken in RETVAL.
+ */
+int
+sys_futex_wake(userptr_t uaddr, int n, int32_t *retval)
+{
+	struct addrspace *as;
+	struct futex_bucket *fb;
+	struct futex *f;
+	int32_t count;
+	int result;
+
+	result = futex_checkaddr(uaddr, &as);
+	if (result) {
+		return result;
+	}
+	if (n < 0) {
+		return EINVAL;
+	}
+	fb = futex_hash(as, (vaddr_t)uaddr);
+
+	count = 0;
+	spinlock_acquire(&fb->fb_lock);
+	f = futex_lookup(fb, as, (vaddr_t)uaddr);
+	if (f != NULL) {
+		f->f_seq++;
+		while (count < n && !wchan_isempty(f->f_wchan)) {
+			wchan_wakeone(f->f_wchan);
+			count++;
+		}
+	}
+	spinlock_release(&fb->fb_lock);
+
+	*retval = count;
+	return 0;
+}
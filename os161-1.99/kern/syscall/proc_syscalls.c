@@ -9,20 +9,23 @@
 #include <thread.h>
 #include <addrspace.h>
 #include <copyinout.h>
+#include <machine/trapframe.h>
 
-  /* this implementation of sys__exit does not do anything with the exit code */
-  /* this needs to be fixed to get exit() and waitpid() working properly */
+  /* the exit code is kept in the process until its parent collects it
+     with waitpid(); see proc_exit() */
 
 void sys__exit(int exitcode) {
 
   struct addrspace *as;
   struct proc *p = curproc;
-  /* for now, just include this to keep the compiler from complaining about
-     an unused variable */
-  (void)exitcode;
 
   DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
 
+  /* get rid of any other user-level threads first */
+  /* note: if another thread is already exiting the process, this
+     just exits the current thread and does not return */
+  uthread_exitothers();
+
   KASSERT(curproc->p_addrspace != NULL);
   as_deactivate();
   /*
@@ -33,15 +36,22 @@ void sys__exit(int exitcode) {
    * messily fatal.
    */
   as = curproc_setas(NULL);
-  as_destroy(as);
+  if (p->p_vforkdone != NULL) {
+    /* borrowed from our parent by vfork; give it back */
+    proc_vfork_done(p);
+  }
+  else {
+    as_destroy(as);
+  }
 
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call */
   proc_remthread(curthread);
 
-  /* if this is the last user process in the system, proc_destroy()
-     will wake up the kernel menu thread */
-  proc_destroy(p);
+  /* this leaves a zombie for the parent, or if there isn't one,
+     destroys the process; if this is the last user process in the
+     system, proc_destroy() will wake up the kernel menu thread */
+  proc_exit(p, _MKWAIT_EXIT(exitcode));
   
   thread_exit();
   /* thread_exit() does not return, so we should never get here */
@@ -49,17 +59,111 @@ void sys__exit(int exitcode) {
 }
 
 
-/* stub handler for getpid() system call                */
+/* entry point for the child's thread; TF is on its own stack */
+static
+void
+fork_child_start(void *tf, unsigned long unused)
+{
+  (void)unused;
+  enter_forked_process(tf);
+}
+
+/* handler for fork() system call                */
+/* the child gets a copy of the address space, and shares the parent's
+   cwd and open files by reference; its thread starts with a copy of TF
+   on its own stack, on whichever cpu is least busy */
+int
+sys_fork(struct trapframe *tf, pid_t *retval)
+{
+  struct proc *child;
+  int result;
+
+  child = proc_create_runprogram(curproc->p_name);
+  if (child == NULL) {
+    return(proc_create_error());
+  }
+  child->p_weight = curproc->p_weight;
+
+  result = as_copy(curproc_getas(), &child->p_addrspace);
+  if (result) {
+    proc_destroy(child);
+    return(result);
+  }
+
+  /* get the pid now; once its thread exists the child may be running */
+  *retval = child->p_pid;
+
+  result = thread_fork_frame(curthread->t_name, child, NULL,
+			     fork_child_start, tf, sizeof(*tf), 0);
+  if (result) {
+    as_destroy(child->p_addrspace);
+    child->p_addrspace = NULL;
+    proc_destroy(child);
+    return(result);
+  }
+  return(0);
+}
+
+/* handler for vfork() system call                */
+/* like fork, but the child runs in the parent's address space instead
+   of a copy, and the parent waits until the child execs or exits; the
+   child starts on the parent's cpu, which the parent is about to
+   leave.
+   only for single-threaded processes: the waiting thread can't give
+   up while the child is using the address space, so a sibling calling
+   _exit would be stuck until the child is done. with more threads
+   this is just fork (as POSIX allows); once there's one thread, only
+   it can make more, and it's busy waiting. */
+int
+sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+  struct proc *p = curproc;
+  struct proc *child;
+  bool done, threaded;
+  int result;
+
+  spinlock_acquire(&p->p_lock);
+  threaded = p->p_nuthreads > 1;
+  spinlock_release(&p->p_lock);
+  if (threaded) {
+    return(sys_fork(tf, retval));
+  }
+
+  child = proc_create_runprogram(curproc->p_name);
+  if (child == NULL) {
+    return(proc_create_error());
+  }
+  child->p_weight = curproc->p_weight;
+  child->p_addrspace = curproc_getas();
+  done = false;
+  child->p_vforkdone = &done;
+
+  *retval = child->p_pid;
+
+  result = thread_fork_frame(curthread->t_name, child, curthread->t_cpu,
+			     fork_child_start, tf, sizeof(*tf), 0);
+  if (result) {
+    child->p_addrspace = NULL;
+    child->p_vforkdone = NULL;
+    proc_destroy(child);
+    return(result);
+  }
+
+  proc_vfork_wait(&done);
+  return(0);
+}
+
+/* handler for getpid() system call                */
 int
 sys_getpid(pid_t *retval)
 {
-  /* for now, this is just a stub that always returns a PID of 1 */
-  /* you need to fix this to make it work properly */
-  *retval = 1;
+  /* p_pid never changes, so no lock is needed */
+  *retval = curproc->p_pid;
   return(0);
 }
 
-/* stub handler for waitpid() system call                */
+/* handler for waitpid() system call                */
+/* pid may be -1 to wait for any child; status may be NULL */
 
 int
 sys_waitpid(pid_t pid,
@@ -70,25 +174,66 @@ sys_waitpid(pid_t pid,
   int exitstatus;
   int result;
 
-  /* this is just a stub implementation that always reports an
-     exit status of 0, regardless of the actual exit status of
-     the specified process.   
-     In fact, this will return 0 even if the specified process
-     is still running, and even if it never existed in the first place.
-
-     Fix this!
-  */
-
-  if (options != 0) {
+  if ((options & ~WNOHANG) != 0) {
     return(EINVAL);
   }
-  /* for now, just pretend the exitstatus is 0 */
-  exitstatus = 0;
-  result = copyout((void *)&exitstatus,status,sizeof(int));
+
+  result = proc_wait(pid, (options & WNOHANG) != 0, retval, &exitstatus);
   if (result) {
     return(result);
   }
-  *retval = pid;
+  if (*retval != 0 && status != NULL) {
+    /* the child is gone now, so there's no retrying if this fails */
+    result = copyout((void *)&exitstatus,status,sizeof(int));
+    if (result) {
+      return(result);
+    }
+  }
   return(0);
 }
 
+
+/*
+ * setpriority: set the scheduling weight of a process, for the
+ * fair-share scheduler (options fairsched; otherwise the weight is
+ * recorded but has no effect). Priorities run from PRIO_MIN (most
+ * cpu) to PRIO_MAX (least); each step is worth about 25%.
+ * For now a process can only set its own priority, named either by
+ * its pid or by 0.
+ */
+static const unsigned prio_weights[PRIO_MAX - PRIO_MIN + 1] = {
+  /* -20 */ 88761, 71755, 56483, 46273, 36291,
+  /* -15 */ 29154, 23254, 18705, 14949, 11916,
+  /* -10 */  9548,  7620,  6100,  4904,  3906,
+  /*  -5 */  3121,  2501,  1991,  1586,  1277,
+  /*   0 */  1024,   820,   655,   526,   423,
+  /*   5 */   335,   272,   215,   172,   137,
+  /*  10 */   110,    87,    70,    56,    45,
+  /*  15 */    36,    29,    23,    18,    15,
+};
+
+int
+sys_setpriority(int which, int who, int prio)
+{
+  struct proc *p = curproc;
+
+  if (which != PRIO_PROCESS) {
+    return(EINVAL);
+  }
+  /* p_pid never changes, so no lock is needed */
+  if (who != 0 && who != p->p_pid) {
+    return(ESRCH);
+  }
+  if (prio < PRIO_MIN) {
+    prio = PRIO_MIN;
+  }
+  if (prio > PRIO_MAX) {
+    prio = PRIO_MAX;
+  }
+
+  KASSERT(prio_weights[0 - PRIO_MIN] == PROC_WEIGHT_DEFAULT);
+  spinlock_acquire(&p->p_lock);
+  p->p_weight = prio_weights[prio - PRIO_MIN];
+  spinlock_release(&p->p_lock);
+  return(0);
+}
@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * System call statistics. See syscallstat.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/syscallstat.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <clock.h>
+#include <current.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <syscallstat.h>
+
+/* How many CPUs we'll keep tables for. */
+#define SYSCALLSTAT_MAXCPUS	32
+
+struct syscallstat_table {
+	struct syscallstats st_calls[SYSCALLSTAT_NCALLS];
+};
+
+volatile bool syscallstat_enabled;
+
+/*
+ * Tables by CPU number. Each is only updated by its own CPU, with
+ * interrupts off, so they need no lock.
+ */
+static struct syscallstat_table *syscallstat_tables[SYSCALLSTAT_MAXCPUS];
+
+/*
+ * Set up a new CPU's table.
+ */
+void
+syscallstat_cpu_init(struct cpu *c)
+{
+	struct syscallstat_table *st;
+
+	if (c->c_number >= SYSCALLSTAT_MAXCPUS) {
+		kprintf("syscallstat: no statistics for cpu%u\n",
+			c->c_number);
+		return;
+	}
+	st = kmalloc(sizeof(*st));
+	if (st == NULL) {
+		panic("syscallstat: Out of memory\n");
+	}
+	bzero(st, sizeof(*st));
+	syscallstat_tables[c->c_number] = st;
+}
+
+/*
+ * Current time in nanoseconds.
+ */
+uint64_t
+syscallstat_now(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+/*
+ * Histogram bucket for a latency of NS.
+ */
+static
+unsigned
+syscallstat_bucket(uint64_t ns)
+{
+	uint64_t us;
+	unsigned b;
+
+	us = ns / 1000;
+	for (b = 0; b < SYSCALLSTAT_NBUCKETS-1; b++) {
+		if (us < (1ULL << b)) {
+			break;
+		}
+	}
+	return b;
+}
+
+/*
+ * Record a call. This goes in the table of whatever CPU the call
+ * finished on.
+ */
+void
+syscallstat_record(int callno, uint64_t ns, int err)
+{
+	struct syscallstat_table *st;
+	struct syscallstats *ss;
+	int spl;
+
+	if (callno < 0 || callno >= SYSCALLSTAT_NCALLS) {
+		return;
+	}
+
+	spl = splhigh();
+	if (curcpu->c_number < SYSCALLSTAT_MAXCPUS) {
+		st = syscallstat_tables[curcpu->c_number];
+		if (st != NULL) {
+			ss = &st->st_calls[callno];
+			ss->ss_count++;
+			if (err) {
+				ss->ss_errors++;
+			}
+			ss->ss_totalns += ns;
+			ss->ss_hist[syscallstat_bucket(ns)]++;
+		}
+	}
+	splx(spl);
+}
+
+/*
+ * Add up the tables for one call. Like lockstat, this just reads
+ * them, so a count in flight might be off by one.
+ */
+void
+syscallstat_get(int callno, struct syscallstats *ret)
+{
+	struct syscallstats *ss;
+	unsigned i, j;
+
+	KASSERT(callno >= 0 && callno < SYSCALLSTAT_NCALLS);
+
+	bzero(ret, sizeof(*ret));
+	for (i=0; i<SYSCALLSTAT_MAXCPUS; i++) {
+		if (syscallstat_tables[i] == NULL) {
+			continue;
+		}
+		ss = &syscallstat_tables[i]->st_calls[callno];
+		ret->ss_count += ss->ss_count;
+		ret->ss_errors += ss->ss_errors;
+		ret->ss_totalns += ss->ss_totalns;
+		for (j=0; j<SYSCALLSTAT_NBUCKETS; j++) {
+			ret->ss_hist[j] += ss->ss_hist[j];
+		}
+	}
+}
+
+/*
+ * Turn collection on or off.
+ */
+void
+syscallstat_enable(bool on)
+{
+	syscallstat_enabled = on;
+}
+
+/*
+ * Zero all the tables. Turn collection off first, or some counts
+ * might survive.
+ */
+void
+syscallstat_clear(void)
+{
+	unsigned i;
+
+	for (i=0; i<SYSCALLSTAT_MAXCPUS; i++) {
+		if (syscallstat_tables[i] != NULL) {
+			bzero(syscallstat_tables[i],
+			      sizeof(*syscallstat_tables[i]));
+		}
+	}
+}
+
+/*
+ * Upper bound of the bucket the median call falls in, in
+ * microseconds, or 0 for the open-ended last bucket.
+ */
+static
+unsigned
+syscallstat_median(const struct syscallstats *ss)
+{
+	unsigned b, seen;
+
+	seen = 0;
+	for (b = 0; b < SYSCALLSTAT_NBUCKETS-1; b++) {
+		seen += ss->ss_hist[b];
+		if (seen * 2 >= ss->ss_count) {
+			return 1U << b;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Total time for one call, across CPUs; cheaper than syscallstat_get
+ * when that's all we want.
+ */
+static
+uint64_t
+syscallstat_totalns(int callno)
+{
+	uint64_t ns;
+	unsigned i;
+
+	ns = 0;
+	for (i=0; i<SYSCALLSTAT_MAXCPUS; i++) {
+		if (syscallstat_tables[i] != NULL) {
+			ns += syscallstat_tables[i]->st_calls[callno].ss_totalns;
+		}
+	}
+	return ns;
+}
+
+#define DONE_WORDS	((SYSCALLSTAT_NCALLS + 31) / 32)
+#define DONE_ISSET(d, n)	(((d)[(n) / 32] & (1U << ((n) % 32))) != 0)
+#define DONE_SET(d, n)		((d)[(n) / 32] |= 1U << ((n) % 32))
+
+/*
+ * Print every call that's been made, busiest first by total time.
+ *
+ * This works from the live tables, picking the busiest call not yet
+ * printed each time around, rather than taking a copy to sort: a
+ * copy of every call's statistics is several pages, and kmalloc'd
+ * pages never come back under dumbvm.
+ */
+void
+syscallstat_report(void)
+{
+	struct syscallstats ss;
+	uint32_t done[DONE_WORDS];
+	uint64_t grandns, ns, bestns;
+	unsigned median;
+	int callno, best;
+	const char *name;
+
+	bzero(done, sizeof(done));
+	grandns = 0;
+	for (callno=0; callno<SYSCALLSTAT_NCALLS; callno++) {
+		syscallstat_get(callno, &ss);
+		grandns += ss.ss_totalns;
+		if (ss.ss_count == 0) {
+			DONE_SET(done, callno);
+		}
+	}
+
+	kprintf("syscallstat: %s\n", syscallstat_enabled ? "on" : "off");
+	kprintf("call            count   errors   total(us)  %%time"
+		"  avg(us)  median(us)\n");
+	while (1) {
+		best = -1;
+		bestns = 0;
+		for (callno=0; callno<SYSCALLSTAT_NCALLS; callno++) {
+			if (DONE_ISSET(done, callno)) {
+				continue;
+			}
+			ns = syscallstat_totalns(callno);
+			if (best < 0 || ns >= bestns) {
+				best = callno;
+				bestns = ns;
+			}
+		}
+		if (best < 0) {
+			break;
+		}
+		DONE_SET(done, best);
+
+		/* Collection may still be on; print what's there now. */
+		syscallstat_get(best, &ss);
+		name = syscall_name(best);
+		if (name != NULL) {
+			kprintf("%-12s", name);
+		}
+		else {
+			kprintf("#%-11d", best);
+		}
+		kprintf(" %8u %8u %11llu %5u%% %8llu",
+			ss.ss_count, ss.ss_errors,
+			(unsigned long long)(ss.ss_totalns / 1000),
+			grandns == 0 ? 0 :
+			(unsigned)(ss.ss_totalns * 100 / grandns),
+			ss.ss_count == 0 ? 0 :
+			(unsigned long long)(ss.ss_totalns / 1000 /
+					     ss.ss_count));
+		median = syscallstat_median(&ss);
+		if (median == 0) {
+			kprintf("  >=%u\n", 1U << (SYSCALLSTAT_NBUCKETS-2));
+		}
+		else {
+			kprintf("  <%u\n", median);
+		}
+	}
+}
+
+/*
+ * Print the latency histogram for the call called NAME.
+ */
+int
+syscallstat_histogram(const char *name)
+{
+	struct syscallstats ss;
+	const char *cname;
+	unsigned b, max, width;
+	int callno;
+
+	for (callno=0; callno<SYSCALLSTAT_NCALLS; callno++) {
+		cname = syscall_name(callno);
+		if (cname != NULL && !strcmp(cname, name)) {
+			break;
+		}
+	}
+	if (callno == SYSCALLSTAT_NCALLS) {
+		kprintf("syscallstat: %s: No such system call\n", name);
+		return ENOSYS;
+	}
+
+	syscallstat_get(callno, &ss);
+	kprintf("%s: %u calls, %u errors, %llu us total\n", name,
+		ss.ss_count, ss.ss_errors,
+		(unsigned long long)(ss.ss_totalns / 1000));
+
+	max = 0;
+	for (b=0; b<SYSCALLSTAT_NBUCKETS; b++) {
+		if (ss.ss_hist[b] > max) {
+			max = ss.ss_hist[b];
+		}
+	}
+	for (b=0; b<SYSCALLSTAT_NBUCKETS; b++) {
+		if (b < SYSCALLSTAT_NBUCKETS-1) {
+			kprintf("  <%6u us %8u ", 1U << b, ss.ss_hist[b]);
+		}
+		else {
+			kprintf(" >=%6u us %8u ", 1U << (b-1), ss.ss_hist[b]);
+		}
+		width = max == 0 ? 0 : ss.ss_hist[b] * 40 / max;
+		while (width-- > 0) {
+			kprintf("*");
+		}
+		kprintf("\n");
+	}
+	return 0;
+}
+
+/*
+ * syscallstats system call: copy out the statistics for CALLNO.
+ */
+int
+sys_syscallstats(int callno, userptr_t stats)
+{
+	struct syscallstats ss;
+
+	if (callno < 0 || callno >= SYSCALLSTAT_NCALLS) {
+		return EINVAL;
+	}
+	syscallstat_get(callno, &ss);
+	return copyout(&ss, stats, sizeof(ss));
+}
@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <futex.h>
+#include <syscall.h>
+
+/*
+ * User-level threads.
+ *
+ * Each user thread is a kernel thread in the same process, running in
+ * the same address space on its own user stack (stack slot N-1 for
+ * thread N; see as_define_threadstack). Thread creation goes through
+ * a libc trampoline, which is where the new thread starts: it sets
+ * up, calls the thread function, and calls threadexit if that
+ * returns.
+ *
+ * p_nuthreads counts the running user threads of the process,
+ * including the first one. Whichever thread leaves last tears down
+ * the process. When any thread calls _exit, the process is marked as
+ * exiting; the other threads then exit the next time they are on
+ * their way back to user mode (uthread_checkexit), and _exit waits
+ * for them before tearing down the process. Threads sleeping in
+ * futex_wait or threadjoin are woken up for this; threads blocked
+ * elsewhere in the kernel are waited for until they return.
+ */
+
+struct uthread_args {
+	vaddr_t ua_start;		/* Trampoline entry point */
+	userptr_t ua_func;		/* User thread function */
+	userptr_t ua_arg;		/* Its argument */
+	vaddr_t ua_stack;		/* Initial stack pointer */
+};
+
+/*
+ * Entry point for new user threads. DATA2 is the thread id.
+ */
+static
+void
+uthread_start(void *data1, unsigned long data2)
+{
+	struct uthread_args *ua = data1;
+	struct uthread_args args;
+	struct proc *p = curproc;
+
+	args = *ua;
+	kfree(ua);
+
+	spinlock_acquire(&p->p_lock);
+	KASSERT(p->p_uthreads[data2 - 1].ut_inuse);
+	p->p_uthreads[data2 - 1].ut_thread = curthread;
+	spinlock_release(&p->p_lock);
+
+	/* Don't bother starting if the process is on its way out. */
+	uthread_checkexit();
+
+	/*
+	 * The trampoline gets the function and argument where a new
+	 * program gets argc and argv.
+	 */
+	enter_new_process((int)(vaddr_t)args.ua_func, args.ua_arg,
+			  args.ua_stack, args.ua_start);
+
+	/* enter_new_process does not return. */
+	panic("enter_new_process returned\n");
+}
+
+/*
+ * Give back a thread record whose thread never got started.
+ */
+static
+void
+uthread_unreserve(struct proc *p, unsigned slot)
+{
+	spinlock_acquire(&p->p_lock);
+	KASSERT(p->p_uthreads[slot].ut_inuse);
+	p->p_uthreads[slot].ut_inuse = false;
+	KASSERT(p->p_nuthreads > 1);
+	p->p_nuthreads--;
+	wchan_wakeall(p->p_uthreadwchan);
+	spinlock_release(&p->p_lock);
+}
+
+/*
+ * Create a new user thread that starts at START (the libc trampoline)
+ * with FUNC and ARG as its arguments. Returns the thread id.
+ */
+int
+sys___threadfork(userptr_t start, userptr_t func, userptr_t arg,
+		 int32_t *retval)
+{
+	struct proc *p = curproc;
+	struct addrspace *as;
+	struct uthread_args *ua;
+	unsigned slot;
+	int result;
+
+	as = curproc_getas();
+	KASSERT(as != NULL);
+
+	/* Find a free thread record, and count the thread as running. */
+	spinlock_acquire(&p->p_lock);
+	for (slot=0; slot<PROC_MAXUTHREADS; slot++) {
+		if (!p->p_uthreads[slot].ut_inuse) {
+			break;
+		}
+	}
+	if (slot == PROC_MAXUTHREADS) {
+		spinlock_release(&p->p_lock);
+		return ENPROC;
+	}
+	p->p_uthreads[slot].ut_inuse = true;
+	p->p_uthreads[slot].ut_exited = false;
+	p->p_uthreads[slot].ut_thread = NULL;
+	p->p_uthreads[slot].ut_exitcode = 0;
+	p->p_nuthreads++;
+	spinlock_release(&p->p_lock);
+
+	ua = kmalloc(sizeof(*ua));
+	if (ua == NULL) {
+		uthread_unreserve(p, slot);
+		return ENOMEM;
+	}
+	ua->ua_start = (vaddr_t)start;
+	ua->ua_func = func;
+	ua->ua_arg = arg;
+
+	KASSERT(slot < AS_THREADSTACKS);
+	result = as_define_threadstack(as, slot, &ua->ua_stack);
+	if (result) {
+		kfree(ua);
+		uthread_unreserve(p, slot);
+		return result;
+	}
+
+	result = thread_fork(curthread->t_name, p, uthread_start,
+			     ua, slot + 1);
+	if (result) {
+		as_release_threadstack(as, slot);
+		kfree(ua);
+		uthread_unreserve(p, slot);
+		return result;
+	}
+
+	*retval = slot + 1;
+	return 0;
+}
+
+/*
+ * Exit the current user thread with exit code CODE. If it's the last
+ * one, the whole process exits.
+ *
+ * Deciding whether we're the last thread and dropping out of
+ * p_nuthreads must be one step, or two threads exiting at once could
+ * each think the other will be left. Our user stack is given back
+ * first: nobody can reuse the slot until we're marked exited, and
+ * the address space can't go away while we're still counted (_exit
+ * and execv wait for that), nor does the last thread need its stack.
+ */
+void
+uthread_exit(int code)
+{
+	struct proc *p = curproc;
+	struct uthread *ut;
+	unsigned slot;
+
+	/* The first thread has no record. */
+	ut = NULL;
+	spinlock_acquire(&p->p_lock);
+	for (slot=0; slot<PROC_MAXUTHREADS; slot++) {
+		if (p->p_uthreads[slot].ut_inuse &&
+		    !p->p_uthreads[slot].ut_exited &&
+		    p->p_uthreads[slot].ut_thread == curthread) {
+			ut = &p->p_uthreads[slot];
+			break;
+		}
+	}
+	spinlock_release(&p->p_lock);
+
+	if (ut != NULL) {
+		as_release_threadstack(curproc_getas(), slot);
+	}
+
+	spinlock_acquire(&p->p_lock);
+	if (p->p_nuthreads == 1) {
+		spinlock_release(&p->p_lock);
+		sys__exit(code);
+		panic("return from sys__exit in uthread_exit\n");
+	}
+	if (ut != NULL) {
+		ut->ut_exited = true;
+		ut->ut_thread = NULL;
+		ut->ut_exitcode = code;
+	}
+	p->p_nuthreads--;
+	wchan_wakeall(p->p_uthreadwchan);
+	spinlock_release(&p->p_lock);
+
+	proc_remthread(curthread);
+	thread_exit();
+}
+
+/*
+ * Make every other user thread in the current process exit, and wait
+ * until they have. Called from _exit. If some other thread is already
+ * doing this, just exit the current thread instead. Threads asleep in
+ * threadjoin or waitpid are woken so they notice.
+ */
+void
+uthread_exitothers(void)
+{
+	struct proc *p = curproc;
+
+	spinlock_acquire(&p->p_lock);
+	if (p->p_exiting) {
+		spinlock_release(&p->p_lock);
+		uthread_exit(0);
+		panic("return from uthread_exit\n");
+	}
+	p->p_exiting = true;
+	if (p->p_nuthreads == 1) {
+		spinlock_release(&p->p_lock);
+		return;
+	}
+	wchan_wakeall(p->p_uthreadwchan);
+	wchan_wakeall(p->p_childwchan);
+	spinlock_release(&p->p_lock);
+
+	futex_wakeall(curproc_getas());
+
+	spinlock_acquire(&p->p_lock);
+	while (p->p_nuthreads > 1) {
+		wchan_lock(p->p_uthreadwchan);
+		spinlock_release(&p->p_lock);
+		wchan_sleep(p->p_uthreadwchan);
+		spinlock_acquire(&p->p_lock);
+	}
+	spinlock_release(&p->p_lock);
+}
+
+/*
+ * For execv: make every other user thread exit, as for _exit, and
+ * then forget them all, so the new program starts with one thread.
+ */
+void
+uthread_exec(void)
+{
+	struct proc *p = curproc;
+	unsigned i;
+
+	uthread_exitothers();
+
+	spinlock_acquire(&p->p_lock);
+	KASSERT(p->p_nuthreads == 1);
+	p->p_exiting = false;
+	for (i=0; i<PROC_MAXUTHREADS; i++) {
+		p->p_uthreads[i].ut_inuse = false;
+		p->p_uthreads[i].ut_exited = false;
+		p->p_uthreads[i].ut_thread = NULL;
+		p->p_uthreads[i].ut_exitcode = 0;
+	}
+	spinlock_release(&p->p_lock);
+}
+
+/*
+ * Called on the way back to user mode: if the process is exiting,
+ * don't go.
+ */
+void
+uthread_checkexit(void)
+{
+	/* Unlocked peek; we'll get it next time if we miss it. */
+	if (curproc != NULL && curproc->p_exiting) {
+		uthread_exit(0);
+	}
+}
+
+void
+sys_threadexit(int code)
+{
+	uthread_exit(code);
+}
+
+/*
+ * Wait for thread TID to exit, and collect its exit code into CODE.
+ */
+int
+sys_threadjoin(int tid, userptr_t code)
+{
+	struct proc *p = curproc;
+	struct uthread *ut;
+	int exitcode;
+
+	if (tid < 1 || tid > PROC_MAXUTHREADS) {
+		return ESRCH;
+	}
+	ut = &p->p_uthreads[tid - 1];
+
+	spinlock_acquire(&p->p_lock);
+	if (ut->ut_inuse && !ut->ut_exited && ut->ut_thread == curthread) {
+		spinlock_release(&p->p_lock);
+		return EINVAL;
+	}
+	while (ut->ut_inuse && !ut->ut_exited && !p->p_exiting) {
+		wchan_lock(p->p_uthreadwchan);
+		spinlock_release(&p->p_lock);
+		wchan_sleep(p->p_uthreadwchan);
+		spinlock_acquire(&p->p_lock);
+	}
+	if (!ut->ut_inuse) {
+		/* Never existed, or someone else joined it. */
+		spinlock_release(&p->p_lock);
+		return ESRCH;
+	}
+	if (!ut->ut_exited) {
+		/* We're exiting; see uthread_checkexit. */
+		spinlock_release(&p->p_lock);
+		return EINTR;
+	}
+	exitcode = ut->ut_exitcode;
+	ut->ut_inuse = false;
+	spinlock_release(&p->p_lock);
+
+	if (code != NULL) {
+		return copyout(&exitcode, code, sizeof(exitcode));
+	}
+	return 0;
+}
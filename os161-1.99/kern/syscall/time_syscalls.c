@@ -28,6 +28,9 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <lib.h>
 #include <clock.h>
 #include <copyinout.h>
 #include <syscall.h>
@@ -56,3 +59,51 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for the time given in REQ. The timer wheel works in
+ * hardclocks, so round up to whole ones, plus one for the partial
+ * period we're already in. We can't be interrupted, so if REM is
+ * given, there's never any time remaining.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec ts;
+	uint64_t ticks;
+	int result;
+
+	result = copyin(user_req, &ts, sizeof(ts));
+	if (result) {
+		return result;
+	}
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	/* Clamp first; a huge tv_sec would wrap the multiplication. */
+	if (ts.tv_sec > 0x7fffffff / HZ) {
+		ts.tv_sec = 0x7fffffff / HZ;
+	}
+	ticks = (uint64_t)ts.tv_sec * HZ
+		+ DIVROUNDUP((uint32_t)ts.tv_nsec, 1000000000 / HZ) + 1;
+	if (ticks > 0x7fffffff) {
+		/* Longer than the wheel can keep track of; sleep anyway. */
+		ticks = 0x7fffffff;
+	}
+
+	result = timeout_sleep(ticks);
+	if (result) {
+		return result;
+	}
+
+	if (user_rem != NULL) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 0;
+		result = copyout(&ts, user_rem, sizeof(ts));
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
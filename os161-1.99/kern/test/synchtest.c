@@ -32,6 +32,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
@@ -347,3 +348,236 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+#if OPT_A1
+/*
+ * Lock ping-pong benchmark.
+ *
+ * A couple of threads take turns at a lock with a tiny critical
+ * section, once with the adaptive lock spinning as usual and once
+ * with spinning turned off, so every contended acquire sleeps. On a
+ * multi-CPU machine the difference is the cost of the context
+ * switches that spinning saves.
+ */
+#define NPINGPONGTHREADS  2
+#define NPINGPONGLOOPS    5000
+
+static struct lock *pplock;
+static struct semaphore *ppdonesem;
+static volatile unsigned long ppcount;
+
+static
+void
+pingpongthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<NPINGPONGLOOPS; i++) {
+		lock_acquire(pplock);
+		ppcount++;
+		lock_release(pplock);
+	}
+	V(ppdonesem);
+}
+
+static
+void
+pingpongrun(const char *what, unsigned spinlimit)
+{
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	unsigned long total;
+	uint64_t ns;
+	int i, result;
+
+	lock_spinlimit = spinlimit;
+	ppcount = 0;
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<NPINGPONGTHREADS; i++) {
+		result = thread_fork("pingpong", NULL, pingpongthread,
+				     NULL, i);
+		if (result) {
+			panic("lockpingpong: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NPINGPONGTHREADS; i++) {
+		P(ppdonesem);
+	}
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs2, &nsecs2);
+
+	total = NPINGPONGTHREADS * NPINGPONGLOOPS;
+	if (ppcount != total) {
+		kprintf("%s: count is %lu, should be %lu\n",
+			what, ppcount, total);
+		kprintf("Test failed\n");
+	}
+	ns = (uint64_t)secs2 * 1000000000 + nsecs2;
+	kprintf("%-10s %lu acquires in %lu.%09lu sec, %lu ns each\n",
+		what, total, (unsigned long)secs2, (unsigned long)nsecs2,
+		(unsigned long)(ns / total));
+}
+
+int
+lockpingpong(int nargs, char **args)
+{
+	unsigned oldlimit;
+
+	(void)nargs;
+	(void)args;
+
+	pplock = lock_create("pplock");
+	ppdonesem = sem_create("ppdonesem", 0);
+	if (pplock == NULL || ppdonesem == NULL) {
+		panic("lockpingpong: out of memory\n");
+	}
+
+	kprintf("Starting lock ping-pong benchmark...\n");
+	oldlimit = lock_spinlimit;
+	pingpongrun("adaptive", oldlimit != 0 ? oldlimit : 1000);
+	pingpongrun("sleeping", 0);
+	lock_spinlimit = oldlimit;
+
+	sem_destroy(ppdonesem);
+	lock_destroy(pplock);
+	kprintf("Lock ping-pong benchmark done.\n");
+	return 0;
+}
+#endif /* OPT_A1 */
+
+/*
+ * Spinlock benchmark.
+ *
+ * Up to NSPINTHREADS threads hammer one lock with an empty critical
+ * section for SPINBENCH_SECS seconds, first with a basic
+ * (test-and-test-and-set) spinlock and then with a ticket lock.
+ * Throughput is the total number of acquisitions; fairness is how
+ * close the least successful thread came to the most successful one.
+ * Threads on the same CPU don't compete (spinlocks are held by CPUs),
+ * so run this on a machine with as many CPUs as you want to measure
+ * and give it that many threads, e.g. "sy5 32".
+ */
+#define NSPINTHREADS     32
+#define SPINBENCH_SECS   2
+
+static struct spinlock benchspinlock = SPINLOCK_INITIALIZER;
+static struct ticketlock benchticketlock = TICKETLOCK_INITIALIZER;
+static struct semaphore *spindonesem;
+static volatile bool spinticket;
+static volatile bool spingo, spinstop;
+static volatile unsigned long spincounter;
+static unsigned long spincounts[NSPINTHREADS];
+
+static
+void
+spinbenchthread(void *junk, unsigned long num)
+{
+	unsigned long count = 0;
+
+	(void)junk;
+
+	while (!spingo) {
+		thread_yield();
+	}
+	if (spinticket) {
+		while (!spinstop) {
+			ticketlock_acquire(&benchticketlock);
+			spincounter++;
+			ticketlock_release(&benchticketlock);
+			count++;
+		}
+	}
+	else {
+		while (!spinstop) {
+			spinlock_acquire(&benchspinlock);
+			spincounter++;
+			spinlock_release(&benchspinlock);
+			count++;
+		}
+	}
+	spincounts[num] = count;
+	V(spindonesem);
+}
+
+static
+void
+spinbenchrun(const char *what, bool ticket, unsigned nthreads)
+{
+	unsigned long total, min, max;
+	unsigned i;
+	int result;
+
+	spinticket = ticket;
+	spingo = false;
+	spinstop = false;
+	spincounter = 0;
+
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("spinbench", NULL, spinbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("spinbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	spingo = true;
+	timeout_sleep(SPINBENCH_SECS * HZ);
+	spinstop = true;
+	for (i=0; i<nthreads; i++) {
+		P(spindonesem);
+	}
+
+	total = 0;
+	min = max = spincounts[0];
+	for (i=0; i<nthreads; i++) {
+		total += spincounts[i];
+		if (spincounts[i] < min) {
+			min = spincounts[i];
+		}
+		if (spincounts[i] > max) {
+			max = spincounts[i];
+		}
+	}
+	if (total != spincounter) {
+		kprintf("%s: counter is %lu, should be %lu\n",
+			what, spincounter, total);
+		kprintf("Test failed\n");
+	}
+	kprintf("%-8s %2u threads: %8lu acquires/sec, "
+		"per thread min %lu max %lu (%lu%%)\n",
+		what, nthreads, total / SPINBENCH_SECS, min, max,
+		max > 0 ? min * 100 / max : 100);
+}
+
+int
+spinbench(int nargs, char **args)
+{
+	unsigned nthreads = NSPINTHREADS;
+
+	if (nargs > 1) {
+		nthreads = atoi(args[1]);
+		if (nthreads < 1 || nthreads > NSPINTHREADS) {
+			kprintf("Usage: sy5 [1-%d]\n", NSPINTHREADS);
+			return EINVAL;
+		}
+	}
+
+	if (spindonesem == NULL) {
+		spindonesem = sem_create("spindonesem", 0);
+		if (spindonesem == NULL) {
+			panic("spinbench: sem_create failed\n");
+		}
+	}
+
+	kprintf("Starting spinlock benchmark...\n");
+	spinbenchrun("spinlock", false, nthreads);
+	spinbenchrun("ticket", true, nthreads);
+	kprintf("Spinlock benchmark done.\n");
+	return 0;
+}
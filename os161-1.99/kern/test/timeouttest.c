@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Timeout test.
+ *
+ * Schedules timeouts at a spread of delays, chosen to land in
+ * different levels of the timer wheel, and checks that they go off
+ * in order and not early. Then has some threads sleep with
+ * timeout_sleep and checks the same for them.
+ */
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define NTIMEOUTS	8
+#define NSLEEPERS	4
+
+/* Delays in hardclocks; not in order, and straddling wheel levels. */
+static const unsigned delays[NTIMEOUTS] = {
+	65, 1, 200, 63, 2, 64, 130, 5,
+};
+
+static struct timeout timeouts[NTIMEOUTS];
+static time_t tstart_secs;
+static uint32_t tstart_nsecs;
+static struct spinlock tlock = SPINLOCK_INITIALIZER;
+static unsigned tfired;
+static unsigned tlastdelay;
+static volatile unsigned tfailures;
+static struct semaphore *tdonesem;
+
+/*
+ * Fail if the time since tstart is less than TICKS-1 hardclocks, the
+ * most a tick-based timeout can be early.
+ */
+static
+void
+checkelapsed(unsigned ticks, const char *what)
+{
+	time_t secs;
+	uint32_t nsecs;
+	uint64_t elapsed, wanted;
+
+	gettime(&secs, &nsecs);
+	getinterval(tstart_secs, tstart_nsecs, secs, nsecs, &secs, &nsecs);
+	elapsed = (uint64_t)secs * 1000000000 + nsecs;
+	wanted = (uint64_t)(ticks - 1) * (1000000000 / HZ);
+	if (elapsed < wanted) {
+		kprintf("timeouttest: %s %u went off early (%llu ns)\n",
+			what, ticks, (unsigned long long)elapsed);
+		tfailures++;
+	}
+}
+
+static
+void
+timeout_fired(void *data)
+{
+	unsigned delay = *(const unsigned *)data;
+
+	checkelapsed(delay, "timeout");
+
+	spinlock_acquire(&tlock);
+	if (delay < tlastdelay) {
+		kprintf("timeouttest: timeout %u went off after %u\n",
+			delay, tlastdelay);
+		tfailures++;
+	}
+	tlastdelay = delay;
+	tfired++;
+	spinlock_release(&tlock);
+}
+
+static
+void
+sleeper(void *junk, unsigned long ticks)
+{
+	int result;
+
+	(void)junk;
+
+	result = timeout_sleep(ticks);
+	if (result) {
+		kprintf("timeouttest: timeout_sleep: %s\n", strerror(result));
+		tfailures++;
+	}
+	checkelapsed(ticks, "sleep of");
+	V(tdonesem);
+}
+
+int
+timeouttest(int nargs, char **args)
+{
+	struct timeout cancelled;
+	unsigned i, maxdelay;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	if (tdonesem == NULL) {
+		tdonesem = sem_create("tdonesem", 0);
+		if (tdonesem == NULL) {
+			panic("timeouttest: sem_create failed\n");
+		}
+	}
+
+	kprintf("Starting timeout test...\n");
+	tfired = 0;
+	tlastdelay = 0;
+	tfailures = 0;
+	gettime(&tstart_secs, &tstart_nsecs);
+
+	maxdelay = 0;
+	for (i=0; i<NTIMEOUTS; i++) {
+		timeout_init(&timeouts[i], timeout_fired,
+			     (void *)&delays[i]);
+		timeout_add(&timeouts[i], delays[i]);
+		if (delays[i] > maxdelay) {
+			maxdelay = delays[i];
+		}
+	}
+
+	/* This one should never go off. */
+	timeout_init(&cancelled, timeout_fired, (void *)&delays[0]);
+	timeout_add(&cancelled, 10);
+	if (!timeout_del(&cancelled)) {
+		kprintf("timeouttest: timeout_del didn't find it\n");
+		tfailures++;
+	}
+
+	for (i=0; i<NSLEEPERS; i++) {
+		result = thread_fork("timeouttest", NULL, sleeper, NULL,
+				     1 + i * 40);
+		if (result) {
+			panic("timeouttest: thread_fork failed %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NSLEEPERS; i++) {
+		P(tdonesem);
+	}
+
+	/* Give the last timeout time to go off. */
+	timeout_sleep(maxdelay + 1);
+	if (tfired != NTIMEOUTS) {
+		kprintf("timeouttest: %u of %u timeouts went off\n",
+			tfired, NTIMEOUTS);
+		tfailures++;
+	}
+
+	kprintf("Timeout test %s.\n", tfailures ? "FAILED" : "done");
+	return 0;
+}
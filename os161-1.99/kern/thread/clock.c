@@ -28,19 +28,25 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
+#include <spl.h>
 #include <cpu.h>
+#include <spinlock.h>
 #include <wchan.h>
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <mainbus.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * Besides the once-a-second lbolt channel, we support timeouts:
+ * callbacks that happen a given number of hardclocks in the future,
+ * kept in a hierarchical timer wheel that is run from hardclock on
+ * one processor. Threads can sleep for a number of ticks with
+ * timeout_sleep.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -50,14 +56,56 @@
  * Timing constants. These should be tuned along with any work done on
  * the scheduler.
  */
-#define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
+#define SCHEDULE_HARDCLOCKS	HZ	/* Boost priorities once a second. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
+/* True if counting from BEFORE to AFTER passed a multiple of N. */
+#define CROSSED(before, after, n)	((before) / (n) != (after) / (n))
+
 /*
  * Once a second, everything waiting on lbolt is awakened by CPU 0.
  */
 static struct wchan *lbolt;
 
+/*
+ * The timer wheel.
+ *
+ * There are TW_LEVELS levels of TW_SIZE slots each. A timeout due
+ * less than TW_SIZE ticks from now goes in level 0, in the slot for
+ * its exact expiry tick; one due within TW_SIZE^2 ticks goes in level
+ * 1, in the slot covering the block of TW_SIZE ticks it falls in; and
+ * so on. Each time level 0 wraps around, the level 1 slot for the
+ * next block is emptied back into the wheel ("cascaded"), and so on
+ * up the levels. So adding and removing timeouts is O(1), and each
+ * timeout gets moved at most TW_LEVELS-1 times on its way to going
+ * off. Timeouts further out than the wheel covers sit in the last
+ * slot of the top level and get cascaded around again as needed.
+ *
+ * Wheel time is the c_hardclocks count of timeout_cpu, the cpu that
+ * runs the wheel. tw_now is the next tick to process; everything
+ * before it has been done. Comparisons are done on differences so
+ * the counter can wrap.
+ *
+ * With tickless operation (below) timeout_cpu's c_hardclocks can be
+ * behind by however long its timer is currently set for, so other
+ * cpus can't tell what time it is there. New timeouts therefore go
+ * on tw_pending, with their delay in to_expires, and timeout_cpu
+ * brings its clock up to date and moves them into the wheel. It
+ * never sets its timer past the next timeout that's due.
+ */
+#define TW_BITS		6
+#define TW_SIZE		(1U << TW_BITS)
+#define TW_MASK		(TW_SIZE - 1)
+#define TW_LEVELS	5
+#define TW_RANGE	(1U << (TW_BITS * TW_LEVELS))
+
+static struct spinlock tw_lock = SPINLOCK_INITIALIZER;
+static struct timeout *tw_wheel[TW_LEVELS][TW_SIZE];
+static unsigned tw_now;			/* next tick to process */
+static unsigned tw_count;		/* number of pending timeouts */
+static struct timeout *tw_pending;	/* not yet in the wheel */
+static struct cpu *timeout_cpu;		/* cpu that runs the wheel */
+
 /*
  * Setup.
  */
@@ -68,6 +116,10 @@ hardclock_bootstrap(void)
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
 	}
+
+	/* The boot cpu runs the timer wheel. */
+	timeout_cpu = curcpu->c_self;
+	tw_now = timeout_cpu->c_hardclocks + 1;
 }
 
 /*
@@ -81,25 +133,409 @@ timerclock(void)
 	wchan_wakeall(lbolt);
 }
 
+////////////////////////////////////////////////////////////
+//
+// Timeouts.
+
+static
+void
+tw_push(struct timeout **head, struct timeout *to)
+{
+	to->to_next = *head;
+	if (to->to_next != NULL) {
+		to->to_next->to_prevp = &to->to_next;
+	}
+	to->to_prevp = head;
+	*head = to;
+}
+
+/*
+ * Put a timeout in the right slot for its expiry time. Timeouts that
+ * are already due go in the slot for the next tick processed.
+ */
+static
+void
+tw_insert(struct timeout *to)
+{
+	unsigned delta, when;
+	unsigned level, slot;
+
+	KASSERT(spinlock_do_i_hold(&tw_lock));
+
+	when = to->to_expires;
+	delta = when - tw_now;
+	if ((int)delta < 0) {
+		when = tw_now;
+		delta = 0;
+	}
+	else if (delta >= TW_RANGE) {
+		when = tw_now + TW_RANGE - 1;
+		delta = TW_RANGE - 1;
+	}
+
+	for (level = 0; level < TW_LEVELS - 1; level++) {
+		if (delta < (1U << (TW_BITS * (level + 1)))) {
+			break;
+		}
+	}
+	slot = (when >> (TW_BITS * level)) & TW_MASK;
+
+	tw_push(&tw_wheel[level][slot], to);
+}
+
+static
+void
+tw_remove(struct timeout *to)
+{
+	KASSERT(spinlock_do_i_hold(&tw_lock));
+	KASSERT(to->to_prevp != NULL);
+
+	*to->to_prevp = to->to_next;
+	if (to->to_next != NULL) {
+		to->to_next->to_prevp = to->to_prevp;
+	}
+	to->to_next = NULL;
+	to->to_prevp = NULL;
+}
+
+/*
+ * Move everything in one slot of a higher level back into the wheel,
+ * which will put it at least one level further down.
+ */
+static
+void
+tw_cascade(unsigned level, unsigned slot)
+{
+	struct timeout *to;
+
+	while ((to = tw_wheel[level][slot]) != NULL) {
+		tw_remove(to);
+		tw_insert(to);
+	}
+}
+
+/*
+ * Move the new timeouts into the wheel, timing them from NOW.
+ */
+static
+void
+tw_drain(unsigned now)
+{
+	struct timeout *to;
+
+	KASSERT(spinlock_do_i_hold(&tw_lock));
+
+	while ((to = tw_pending) != NULL) {
+		tw_remove(to);
+		to->to_expires += now;
+		tw_insert(to);
+	}
+}
+
+/*
+ * Find the (wheel) time by which the wheel next needs to run, if
+ * there's anything in it. Level 0 is scanned exactly up to the next
+ * multiple of TW_SIZE; past that, the next cascade is the next thing
+ * that can happen.
+ */
+static
+bool
+tw_nextevent(unsigned *when)
+{
+	unsigned t, cascade;
+
+	KASSERT(spinlock_do_i_hold(&tw_lock));
+
+	if (tw_count == 0) {
+		return false;
+	}
+	cascade = (tw_now + TW_MASK) & ~TW_MASK;
+	for (t = tw_now; t != cascade; t++) {
+		if (tw_wheel[0][t & TW_MASK] != NULL) {
+			break;
+		}
+	}
+	*when = t;
+	return true;
+}
+
+/*
+ * Run the wheel up to wheel time NOW. Called from hardclock on
+ * timeout_cpu. Timeout functions are called with no locks held, in
+ * the timer interrupt, one at a time so that they can add or delete
+ * timeouts (including themselves) as they please.
+ */
+static
+void
+tw_run(unsigned now)
+{
+	struct timeout *to;
+	unsigned level, slot;
+	void (*func)(void *);
+	void *data;
+
+	spinlock_acquire(&tw_lock);
+	tw_drain(now);
+	while ((int)(now - tw_now) >= 0) {
+		if (tw_count == 0) {
+			/* Nothing to do; skip ahead. */
+			tw_now = now + 1;
+			break;
+		}
+
+		/* On wrapping around a level, cascade the next level up. */
+		for (level = 1; level < TW_LEVELS; level++) {
+			if (((tw_now >> (TW_BITS * (level - 1))) & TW_MASK)
+			    != 0) {
+				break;
+			}
+			slot = (tw_now >> (TW_BITS * level)) & TW_MASK;
+			tw_cascade(level, slot);
+		}
+
+		slot = tw_now & TW_MASK;
+		while ((to = tw_wheel[0][slot]) != NULL) {
+			tw_remove(to);
+			tw_count--;
+			func = to->to_func;
+			data = to->to_data;
+			spinlock_release(&tw_lock);
+			func(data);
+			spinlock_acquire(&tw_lock);
+		}
+		tw_now++;
+	}
+	spinlock_release(&tw_lock);
+}
+
+/*
+ * Initialize a timeout, to call FUNC(DATA) when it goes off.
+ */
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *data)
+{
+	to->to_next = NULL;
+	to->to_prevp = NULL;
+	to->to_expires = 0;
+	to->to_func = func;
+	to->to_data = data;
+}
+
+/*
+ * Schedule a timeout to go off TICKS hardclocks from now, or rather,
+ * on the TICKSth hardclock from now on timeout_cpu; like any tick
+ * based timeout, that can be up to one period early. If it was
+ * already pending, it is rescheduled.
+ */
+void
+timeout_add(struct timeout *to, unsigned ticks)
+{
+	bool poke;
+	int spl;
+
+	spinlock_acquire(&tw_lock);
+	if (to->to_prevp != NULL) {
+		tw_remove(to);
+	}
+	else {
+		tw_count++;
+	}
+	to->to_expires = (ticks > 0) ? ticks : 1;
+	tw_push(&tw_pending, to);
+	/* See hardclock_setperiod. */
+	poke = (timeout_cpu->c_hardclock_period != 1);
+	spinlock_release(&tw_lock);
+
+	/*
+	 * Get timeout_cpu to pick it up. If it's ticking every period
+	 * it will at the next hardclock; otherwise it needs a poke.
+	 */
+	if (timeout_cpu == curcpu->c_self) {
+		spl = splhigh();
+		hardclock_setperiod(curcpu->c_hardclock_period);
+		splx(spl);
+	}
+	else if (poke) {
+		ipi_send(timeout_cpu, IPI_UNIDLE);
+	}
+}
+
+/*
+ * Cancel a timeout. Returns true if it was pending; false means it
+ * had already gone off (or was never scheduled), and in the former
+ * case its function may still be running on timeout_cpu.
+ */
+bool
+timeout_del(struct timeout *to)
+{
+	bool pending;
+
+	spinlock_acquire(&tw_lock);
+	pending = (to->to_prevp != NULL);
+	if (pending) {
+		tw_remove(to);
+		tw_count--;
+	}
+	spinlock_release(&tw_lock);
+	return pending;
+}
+
+/*
+ * Sleeping for a number of ticks.
+ */
+struct timeout_sleeper {
+	struct spinlock ts_lock;
+	struct wchan *ts_wchan;
+	bool ts_done;
+};
+
+static
+void
+timeout_wakeup(void *data)
+{
+	struct timeout_sleeper *ts = data;
+
+	spinlock_acquire(&ts->ts_lock);
+	ts->ts_done = true;
+	wchan_wakeall(ts->ts_wchan);
+	spinlock_release(&ts->ts_lock);
+}
+
+/*
+ * Suspend execution for at least TICKS hardclocks.
+ */
+int
+timeout_sleep(unsigned ticks)
+{
+	struct timeout_sleeper ts;
+	struct timeout to;
+
+	ts.ts_wchan = wchan_create("timeout_sleep");
+	if (ts.ts_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&ts.ts_lock);
+	ts.ts_done = false;
+	timeout_init(&to, timeout_wakeup, &ts);
+
+	spinlock_acquire(&ts.ts_lock);
+	timeout_add(&to, ticks);
+	while (!ts.ts_done) {
+		wchan_lock(ts.ts_wchan);
+		spinlock_release(&ts.ts_lock);
+		wchan_sleep(ts.ts_wchan);
+		spinlock_acquire(&ts.ts_lock);
+	}
+	spinlock_release(&ts.ts_lock);
+
+	spinlock_cleanup(&ts.ts_lock);
+	wchan_destroy(ts.ts_wchan);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Hardclock.
+
+/*
+ * Tickless operation.
+ *
+ * The timer only needs to interrupt a cpu when hardclock has
+ * something to do there. On an idle cpu it doesn't, so thread_switch
+ * turns the timer off while idling and turns it back on when the cpu
+ * wakes up. On a busy cpu with nothing else runnable, the only thing
+ * a tick would do is charge the current thread, so thread_tick asks
+ * for the next interrupt at the end of its time slice instead; if
+ * another thread becomes runnable in the meantime, the periodic tick
+ * is brought back (by IPI if it's on another cpu). The exception is
+ * timeout_cpu, which never waits longer than until the next timeout.
+ *
+ * c_hardclock_period is the number of 1/HZ periods the timer is
+ * currently set for; hardclock charges that many when it goes off.
+ * If the timer is cut short by changing the period, the periods that
+ * went by so far are charged here instead.
+ *
+ * Must be called with interrupts off, since it's per-cpu state.
+ */
+void
+hardclock_setperiod(unsigned hardclocks)
+{
+	bool runswheel;
+	unsigned when, lag;
+
+	/*
+	 * On timeout_cpu, hold tw_lock throughout so timeout_add sees
+	 * either the new timeouts drained or the period they need
+	 * poking out of.
+	 */
+	runswheel = (curcpu->c_self == timeout_cpu);
+	if (runswheel) {
+		spinlock_acquire(&tw_lock);
+		if (tw_pending != NULL) {
+			/* Bring our clock up to date to time them from now. */
+			curcpu->c_hardclocks +=
+				mainbus_timer_set(curcpu->c_hardclock_period);
+			tw_drain(curcpu->c_hardclocks);
+		}
+		if (tw_nextevent(&when)) {
+			lag = when - curcpu->c_hardclocks;
+			if ((int)lag < 1) {
+				lag = 1;
+			}
+			if (hardclocks == 0 || lag < hardclocks) {
+				hardclocks = lag;
+			}
+		}
+	}
+
+	if (curcpu->c_hardclock_period != hardclocks) {
+		curcpu->c_hardclock_period = hardclocks;
+		curcpu->c_hardclocks += mainbus_timer_set(hardclocks);
+	}
+
+	if (runswheel) {
+		spinlock_release(&tw_lock);
+	}
+}
+
 /*
  * This is called HZ times a second (on each processor) by the timer
- * code.
+ * code, or less often when the cpu is idle or lightly loaded.
  */
 void
 hardclock(void)
 {
+	unsigned ticks, before, elapsed;
+
+	/* Rearm the timer. This also clears the interrupt. */
+	ticks = curcpu->c_hardclock_period;
+	elapsed = mainbus_timer_set(ticks);
+	if (ticks == 0) {
+		/* Stopped for idling, but it went off anyway. */
+		curcpu->c_hardclocks += elapsed;
+		return;
+	}
+
 	/*
 	 * Collect statistics here as desired.
 	 */
 
-	curcpu->c_hardclocks++;
-	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
+	before = curcpu->c_hardclocks;
+	curcpu->c_hardclocks += ticks;
+	if (curcpu->c_self == timeout_cpu) {
+		tw_run(curcpu->c_hardclocks);
+	}
+	if (CROSSED(before, curcpu->c_hardclocks, SCHEDULE_HARDCLOCKS)) {
 		schedule();
 	}
-	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
+	if (CROSSED(before, curcpu->c_hardclocks, MIGRATE_HARDCLOCKS)) {
 		thread_consider_migration();
 	}
-	thread_yield();
+	if (curcpu->c_isidle) {
+		/* Back to sleep until the next thing to do, if any. */
+		hardclock_setperiod(0);
+	}
+	thread_tick(ticks);
 }
 
 /*
@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Lock contention statistics. See lockstat.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <clock.h>
+#include <current.h>
+#include <lockstat.h>
+
+/* Entries in each CPU's table; a power of 2. */
+#define LOCKSTAT_SIZE		128
+/* How many CPUs we'll keep tables for. */
+#define LOCKSTAT_MAXCPUS	32
+/* How much of a lock's name we keep. */
+#define LOCKSTAT_NAMELEN	20
+
+struct lockstat_entry {
+	const void *ls_lock;		/* the lock; NULL if unused */
+	unsigned ls_kind;		/* LOCKSTAT_SPINLOCK, etc. */
+	char ls_name[LOCKSTAT_NAMELEN];	/* copy of the name, if any */
+	unsigned ls_acquires;		/* times acquired */
+	unsigned ls_contended;		/* times it wasn't free */
+	uint64_t ls_spins;		/* total spin iterations */
+	uint64_t ls_waitns;		/* total time asleep waiting */
+	uint64_t ls_maxholdns;		/* longest time held */
+};
+
+struct lockstat_table {
+	struct lockstat_entry lt_entries[LOCKSTAT_SIZE];
+	unsigned lt_dropped;		/* updates lost to a full table */
+};
+
+volatile bool lockstat_enabled;
+
+/*
+ * Tables by CPU number. Each is only updated by its own CPU, with
+ * interrupts off, so they need no lock; the report just reads them,
+ * so it might see a count that's off by one in flight.
+ */
+static struct lockstat_table *lockstat_tables[LOCKSTAT_MAXCPUS];
+
+/*
+ * Space for lockstat_report to merge the tables in: a table's worth
+ * of entries per CPU, allocated along with the tables, since
+ * allocating (and under dumbvm, leaking) several pages on each
+ * report won't do. Only the menu makes reports, one at a time.
+ */
+static struct lockstat_entry *lockstat_merge[LOCKSTAT_MAXCPUS];
+static unsigned lockstat_nmerge;
+
+/*
+ * Set up a new CPU's table.
+ */
+void
+lockstat_cpu_init(struct cpu *c)
+{
+	struct lockstat_table *lt;
+
+	if (c->c_number >= LOCKSTAT_MAXCPUS) {
+		kprintf("lockstat: no statistics for cpu%u\n", c->c_number);
+		return;
+	}
+	lt = kmalloc(sizeof(*lt));
+	if (lt == NULL) {
+		panic("lockstat: Out of memory\n");
+	}
+	bzero(lt, sizeof(*lt));
+	lockstat_merge[lockstat_nmerge] =
+		kmalloc(LOCKSTAT_SIZE * sizeof(struct lockstat_entry));
+	if (lockstat_merge[lockstat_nmerge] == NULL) {
+		panic("lockstat: Out of memory\n");
+	}
+	lockstat_nmerge++;
+	lockstat_tables[c->c_number] = lt;
+}
+
+/*
+ * Current time in nanoseconds.
+ */
+uint64_t
+lockstat_now(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+/*
+ * Copy a lock's name, which might not outlive the lock.
+ */
+static
+void
+lockstat_copyname(char *buf, const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<LOCKSTAT_NAMELEN-1 && name[i] != 0; i++) {
+		buf[i] = name[i];
+	}
+	buf[i] = 0;
+}
+
+/*
+ * Find (or make) the entry for a lock in the current CPU's table.
+ * Interrupts must be off. Returns NULL if there's no room.
+ */
+static
+struct lockstat_entry *
+lockstat_find(const void *lock, unsigned kind, const char *name)
+{
+	struct lockstat_table *lt;
+	struct lockstat_entry *ls;
+	unsigned i, h;
+
+	KASSERT(curthread->t_curspl > 0);
+
+	if (!CURCPU_EXISTS() || curcpu->c_number >= LOCKSTAT_MAXCPUS) {
+		return NULL;
+	}
+	lt = lockstat_tables[curcpu->c_number];
+	if (lt == NULL) {
+		return NULL;
+	}
+
+	/* Locks are at least word aligned, so skip the low bits. */
+	h = ((uintptr_t)lock >> 2) * 2654435761U;
+	for (i=0; i<LOCKSTAT_SIZE; i++) {
+		ls = &lt->lt_entries[(h + i) % LOCKSTAT_SIZE];
+		if (ls->ls_lock == lock && ls->ls_kind == kind) {
+			return ls;
+		}
+		if (ls->ls_lock == NULL) {
+			ls->ls_lock = lock;
+			ls->ls_kind = kind;
+			if (name != NULL) {
+				lockstat_copyname(ls->ls_name, name);
+			}
+			return ls;
+		}
+	}
+	lt->lt_dropped++;
+	return NULL;
+}
+
+/*
+ * Record an acquisition.
+ */
+void
+lockstat_acquired(const void *lock, unsigned kind, const char *name,
+		  unsigned spins, uint64_t waitns)
+{
+	struct lockstat_entry *ls;
+	int spl;
+
+	spl = splhigh();
+	ls = lockstat_find(lock, kind, name);
+	if (ls != NULL) {
+		ls->ls_acquires++;
+		if (spins > 0 || waitns > 0) {
+			ls->ls_contended++;
+		}
+		ls->ls_spins += spins;
+		ls->ls_waitns += waitns;
+	}
+	splx(spl);
+}
+
+/*
+ * Record a release. This may be on a different CPU from the
+ * acquisition (for sleep locks), in which case the two CPUs' entries
+ * get added together in the report.
+ */
+void
+lockstat_released(const void *lock, unsigned kind, const char *name,
+		  uint64_t holdns)
+{
+	struct lockstat_entry *ls;
+	int spl;
+
+	spl = splhigh();
+	ls = lockstat_find(lock, kind, name);
+	if (ls != NULL && holdns > ls->ls_maxholdns) {
+		ls->ls_maxholdns = holdns;
+	}
+	splx(spl);
+}
+
+/*
+ * Turn collection on or off.
+ */
+void
+lockstat_enable(bool on)
+{
+	lockstat_enabled = on;
+}
+
+/*
+ * Zero all the tables. Turn collection off first, or some counts
+ * might survive.
+ */
+void
+lockstat_clear(void)
+{
+	unsigned i;
+
+	for (i=0; i<LOCKSTAT_MAXCPUS; i++) {
+		if (lockstat_tables[i] != NULL) {
+			bzero(lockstat_tables[i], sizeof(*lockstat_tables[i]));
+		}
+	}
+}
+
+/*
+ * Does A belong ahead of B in the report? Most contended first.
+ */
+static
+bool
+lockstat_worse(const struct lockstat_entry *a, const struct lockstat_entry *b)
+{
+	if (a->ls_contended != b->ls_contended) {
+		return a->ls_contended > b->ls_contended;
+	}
+	if (a->ls_waitns + a->ls_spins != b->ls_waitns + b->ls_spins) {
+		return a->ls_waitns + a->ls_spins > b->ls_waitns + b->ls_spins;
+	}
+	return a->ls_acquires > b->ls_acquires;
+}
+
+/*
+ * Entry N of the merged table.
+ */
+static
+struct lockstat_entry *
+lockstat_merged(unsigned n)
+{
+	KASSERT(n / LOCKSTAT_SIZE < lockstat_nmerge);
+	return &lockstat_merge[n / LOCKSTAT_SIZE][n % LOCKSTAT_SIZE];
+}
+
+/*
+ * Add up the CPUs' tables and print the HOWMANY most contended locks.
+ */
+void
+lockstat_report(unsigned howmany)
+{
+	static const char *const kinds[] = { "spin", "lock", "sem" };
+	struct lockstat_entry *ls, *m, *best, tmp;
+	unsigned nall, dropped, i, j, k;
+
+	/* Merge entries for the same lock from different CPUs. */
+	nall = 0;
+	dropped = 0;
+	for (i=0; i<LOCKSTAT_MAXCPUS; i++) {
+		if (lockstat_tables[i] == NULL) {
+			continue;
+		}
+		dropped += lockstat_tables[i]->lt_dropped;
+		for (j=0; j<LOCKSTAT_SIZE; j++) {
+			ls = &lockstat_tables[i]->lt_entries[j];
+			if (ls->ls_lock == NULL) {
+				continue;
+			}
+			for (k=0; k<nall; k++) {
+				m = lockstat_merged(k);
+				if (m->ls_lock == ls->ls_lock &&
+				    m->ls_kind == ls->ls_kind) {
+					break;
+				}
+			}
+			if (k == nall) {
+				m = lockstat_merged(nall);
+				*m = *ls;
+				nall++;
+				continue;
+			}
+			m->ls_acquires += ls->ls_acquires;
+			m->ls_contended += ls->ls_contended;
+			m->ls_spins += ls->ls_spins;
+			m->ls_waitns += ls->ls_waitns;
+			if (ls->ls_maxholdns > m->ls_maxholdns) {
+				m->ls_maxholdns = ls->ls_maxholdns;
+			}
+		}
+	}
+
+	/* Selection sort just as far as we're printing. */
+	if (howmany > nall) {
+		howmany = nall;
+	}
+	for (i=0; i<howmany; i++) {
+		best = lockstat_merged(i);
+		for (j=i+1; j<nall; j++) {
+			m = lockstat_merged(j);
+			if (lockstat_worse(m, best)) {
+				best = m;
+			}
+		}
+		m = lockstat_merged(i);
+		tmp = *m;
+		*m = *best;
+		*best = tmp;
+	}
+
+	kprintf("lockstat: %s, %u locks seen, %u updates dropped\n",
+		lockstat_enabled ? "on" : "off", nall, dropped);
+	kprintf("kind name                  acquires contended      spins"
+		"   wait(us) maxhold(us)\n");
+	for (i=0; i<howmany; i++) {
+		ls = lockstat_merged(i);
+		if (ls->ls_name[0] != 0) {
+			kprintf("%-4s %-20s", kinds[ls->ls_kind], ls->ls_name);
+		}
+		else {
+			kprintf("%-4s %-20p", kinds[ls->ls_kind], ls->ls_lock);
+		}
+		kprintf(" %9u %9u %10llu %10llu",
+			ls->ls_acquires, ls->ls_contended,
+			(unsigned long long)ls->ls_spins,
+			(unsigned long long)(ls->ls_waitns / 1000));
+		if (ls->ls_kind == LOCKSTAT_SEM) {
+			kprintf("           -\n");
+		}
+		else {
+			kprintf(" %11llu\n",
+				(unsigned long long)(ls->ls_maxholdns / 1000));
+		}
+	}
+}
@@ -0,0 +1,558 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Scheduler event trace. See schedtrace.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <thread.h>
+#include <clock.h>
+#include <current.h>
+#include <lamebus/ltrace.h>
+#include <schedtrace.h>
+
+/* Events in each CPU's ring; a power of 2. */
+#define SCHEDTRACE_SIZE		256
+/* How many CPUs we'll keep rings for. */
+#define SCHEDTRACE_MAXCPUS	32
+/* How much of a thread's name we keep. */
+#define SCHEDTRACE_NAMELEN	16
+/*
+ * Run queue latency histogram buckets: bucket 0 is under 1us, bucket
+ * N is [2^(N-1), 2^N) us, and the last one is everything longer.
+ */
+#define SCHEDTRACE_NBUCKETS	22
+/*
+ * Threads we'll keep CPU time for in the summary. The table has to
+ * come in under kmalloc's largest subpage size (2048, exclusive), as
+ * bigger allocations take pages that dumbvm never frees.
+ */
+#define SCHEDTRACE_MAXTHREADS	48
+
+/*
+ * Code passed to ltrace_debug: 0x5c in the top byte, then the event
+ * kind, the cpu number, and the other cpu for wakeups and migrations
+ * or the new state for switchouts.
+ */
+#define SCHEDTRACE_LTRACE(kind, cpu, other) \
+	(0x5c000000U | ((kind) << 16) | (((cpu) & 0xff) << 8) | ((other) & 0xff))
+
+struct schedtrace_event {
+	uint64_t se_time;		/* when, in nanoseconds */
+	const struct thread *se_thread;	/* the thread; NULL for idle */
+	char se_name[SCHEDTRACE_NAMELEN]; /* copy of its name */
+	uint32_t se_ns;			/* ran/waited/idled for (ns) */
+	uint8_t se_kind;		/* SCHEDTRACE_SWITCHOUT, etc. */
+	uint8_t se_other;		/* other cpu, or new state */
+};
+
+struct schedtrace_ring {
+	struct schedtrace_event sr_events[SCHEDTRACE_SIZE];
+	unsigned sr_count;		/* events logged; next goes in
+					   sr_count % SCHEDTRACE_SIZE */
+	uint64_t sr_idlestart;		/* when this cpu last went idle */
+	unsigned sr_latency[SCHEDTRACE_NBUCKETS]; /* run queue latency */
+};
+
+volatile bool schedtrace_enabled;
+static volatile bool schedtrace_toltrace;
+
+/*
+ * When logging was last turned on. Thread timestamps from before then
+ * are left over from an earlier run and ignored.
+ */
+static uint64_t schedtrace_since;
+
+/*
+ * Rings by CPU number. Each is only written by its own CPU, with
+ * interrupts off, so they need no lock.
+ */
+static struct schedtrace_ring *schedtrace_rings[SCHEDTRACE_MAXCPUS];
+
+/*
+ * Set up a new CPU's ring.
+ */
+void
+schedtrace_cpu_init(struct cpu *c)
+{
+	struct schedtrace_ring *sr;
+
+	if (c->c_number >= SCHEDTRACE_MAXCPUS) {
+		kprintf("schedtrace: no trace for cpu%u\n", c->c_number);
+		return;
+	}
+	sr = kmalloc(sizeof(*sr));
+	if (sr == NULL) {
+		panic("schedtrace: Out of memory\n");
+	}
+	bzero(sr, sizeof(*sr));
+	schedtrace_rings[c->c_number] = sr;
+}
+
+/*
+ * Current time in nanoseconds.
+ */
+static
+uint64_t
+schedtrace_now(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+/*
+ * Time since STAMP, or 0 if STAMP isn't from this run. Saturates
+ * rather than wrapping, at a little over four seconds.
+ */
+static
+uint32_t
+schedtrace_elapsed(uint64_t now, uint64_t stamp)
+{
+	if (stamp < schedtrace_since || stamp > now) {
+		return 0;
+	}
+	if (now - stamp > 0xffffffffU) {
+		return 0xffffffffU;
+	}
+	return now - stamp;
+}
+
+/*
+ * The current CPU's ring, or NULL. Interrupts must be off.
+ */
+static
+struct schedtrace_ring *
+schedtrace_myring(void)
+{
+	KASSERT(curthread->t_curspl > 0);
+
+	if (!CURCPU_EXISTS() || curcpu->c_number >= SCHEDTRACE_MAXCPUS) {
+		return NULL;
+	}
+	return schedtrace_rings[curcpu->c_number];
+}
+
+/*
+ * Log an event in the current CPU's ring.
+ */
+static
+void
+schedtrace_log(struct schedtrace_ring *sr, uint64_t now, unsigned kind,
+	       const struct thread *t, uint32_t ns, unsigned other)
+{
+	struct schedtrace_event *se;
+	unsigned i;
+
+	se = &sr->sr_events[sr->sr_count % SCHEDTRACE_SIZE];
+	se->se_time = now;
+	se->se_thread = t;
+	se->se_name[0] = 0;
+	if (t != NULL) {
+		for (i=0; i<SCHEDTRACE_NAMELEN-1 && t->t_name[i] != 0; i++) {
+			se->se_name[i] = t->t_name[i];
+		}
+		se->se_name[i] = 0;
+	}
+	se->se_ns = ns;
+	se->se_kind = kind;
+	se->se_other = other;
+	sr->sr_count++;
+
+	if (schedtrace_toltrace) {
+		ltrace_debug(SCHEDTRACE_LTRACE(kind, curcpu->c_number, other));
+	}
+}
+
+void
+schedtrace_switch(struct thread *cur, struct thread *next, unsigned newstate)
+{
+	struct schedtrace_ring *sr;
+	uint64_t now;
+	uint32_t ns;
+	unsigned b;
+
+	sr = schedtrace_myring();
+	if (sr == NULL) {
+		return;
+	}
+	now = schedtrace_now();
+
+	schedtrace_log(sr, now, SCHEDTRACE_SWITCHOUT, cur,
+		       schedtrace_elapsed(now, cur->t_oncputime), newstate);
+	cur->t_oncputime = 0;
+
+	ns = schedtrace_elapsed(now, next->t_readytime);
+	if (next->t_readytime >= schedtrace_since) {
+		for (b=0; b<SCHEDTRACE_NBUCKETS-1 && ns >= 1000U << b; b++) {
+			/* nothing */
+		}
+		sr->sr_latency[b]++;
+	}
+	schedtrace_log(sr, now, SCHEDTRACE_SWITCHIN, next, ns, 0);
+	next->t_readytime = 0;
+	next->t_oncputime = now;
+}
+
+void
+schedtrace_wakeup(struct thread *thread, struct cpu *c)
+{
+	struct schedtrace_ring *sr;
+	uint64_t now;
+
+	sr = schedtrace_myring();
+	if (sr == NULL) {
+		return;
+	}
+	now = schedtrace_now();
+	schedtrace_log(sr, now, SCHEDTRACE_WAKEUP, thread, 0, c->c_number);
+	thread->t_readytime = now;
+}
+
+void
+schedtrace_migrate(struct thread *thread, struct cpu *from)
+{
+	struct schedtrace_ring *sr;
+
+	sr = schedtrace_myring();
+	if (sr == NULL) {
+		return;
+	}
+	schedtrace_log(sr, schedtrace_now(), SCHEDTRACE_MIGRATE, thread, 0,
+		       from->c_number);
+}
+
+void
+schedtrace_idle(bool idle)
+{
+	struct schedtrace_ring *sr;
+	uint64_t now;
+
+	sr = schedtrace_myring();
+	if (sr == NULL) {
+		return;
+	}
+	now = schedtrace_now();
+	if (idle) {
+		schedtrace_log(sr, now, SCHEDTRACE_IDLE, NULL, 0, 0);
+		sr->sr_idlestart = now;
+	}
+	else {
+		schedtrace_log(sr, now, SCHEDTRACE_UNIDLE, NULL,
+			       schedtrace_elapsed(now, sr->sr_idlestart), 0);
+	}
+}
+
+/*
+ * Turn logging on or off.
+ */
+void
+schedtrace_enable(bool on)
+{
+	if (on && !schedtrace_enabled) {
+		schedtrace_since = schedtrace_now();
+	}
+	schedtrace_enabled = on;
+}
+
+/*
+ * Turn mirroring to trace161 on or off.
+ */
+void
+schedtrace_ltrace(bool on)
+{
+	schedtrace_toltrace = on;
+}
+
+/*
+ * Empty all the rings. Turn logging off first, or some events might
+ * survive.
+ */
+void
+schedtrace_clear(void)
+{
+	unsigned i;
+
+	for (i=0; i<SCHEDTRACE_MAXCPUS; i++) {
+		if (schedtrace_rings[i] != NULL) {
+			bzero(schedtrace_rings[i], sizeof(*schedtrace_rings[i]));
+		}
+	}
+}
+
+/*
+ * Number of events still in a ring.
+ */
+static
+unsigned
+schedtrace_held(const struct schedtrace_ring *sr)
+{
+	return sr->sr_count < SCHEDTRACE_SIZE ? sr->sr_count : SCHEDTRACE_SIZE;
+}
+
+/*
+ * Print one event.
+ */
+static
+void
+schedtrace_print(unsigned cpunum, const struct schedtrace_event *se)
+{
+	static const char *const kinds[] = {
+		"out", "in", "wakeup", "migrate", "idle", "unidle",
+	};
+	static const char *const states[] = {
+		"run", "ready", "sleep", "zombie",
+	};
+
+	kprintf("%llu.%09u cpu%-2u %-7s %-16s",
+		(unsigned long long)(se->se_time / 1000000000),
+		(unsigned)(se->se_time % 1000000000), cpunum,
+		kinds[se->se_kind], se->se_name);
+	switch (se->se_kind) {
+	    case SCHEDTRACE_SWITCHOUT:
+		kprintf(" ran %uus, now %s\n", se->se_ns / 1000,
+			se->se_other <= S_ZOMBIE ? states[se->se_other] : "?");
+		break;
+	    case SCHEDTRACE_SWITCHIN:
+		kprintf(" waited %uus\n", se->se_ns / 1000);
+		break;
+	    case SCHEDTRACE_WAKEUP:
+		kprintf(" onto cpu%u\n", se->se_other);
+		break;
+	    case SCHEDTRACE_MIGRATE:
+		kprintf(" from cpu%u\n", se->se_other);
+		break;
+	    case SCHEDTRACE_UNIDLE:
+		kprintf(" idled %uus\n", se->se_ns / 1000);
+		break;
+	    default:
+		kprintf("\n");
+		break;
+	}
+}
+
+/*
+ * Print the HOWMANY most recent events from all the CPUs, oldest
+ * first, merging the rings by time. This is done in place, in two
+ * passes (back from the newest to find where to start, then forward
+ * printing), rather than by copying the events out, which for a long
+ * dump would take pages of memory dumbvm never gives back. So turn
+ * logging off first, or events may be overwritten under us.
+ */
+void
+schedtrace_dump(unsigned howmany)
+{
+	unsigned lo[SCHEDTRACE_MAXCPUS], hi[SCHEDTRACE_MAXCPUS];
+	unsigned cur[SCHEDTRACE_MAXCPUS];
+	struct schedtrace_ring *sr;
+	const struct schedtrace_event *se, *best;
+	unsigned i, n, bestcpu;
+
+	for (i=0; i<SCHEDTRACE_MAXCPUS; i++) {
+		sr = schedtrace_rings[i];
+		hi[i] = sr != NULL ? sr->sr_count : 0;
+		lo[i] = sr != NULL ? hi[i] - schedtrace_held(sr) : 0;
+		cur[i] = hi[i];
+	}
+
+	/* Walk backwards from the newest event on each cpu. */
+	for (n=0; n<howmany; n++) {
+		best = NULL;
+		bestcpu = 0;
+		for (i=0; i<SCHEDTRACE_MAXCPUS; i++) {
+			if (cur[i] == lo[i]) {
+				continue;
+			}
+			sr = schedtrace_rings[i];
+			se = &sr->sr_events[(cur[i] - 1) % SCHEDTRACE_SIZE];
+			if (best == NULL || se->se_time > best->se_time) {
+				best = se;
+				bestcpu = i;
+			}
+		}
+		if (best == NULL) {
+			break;
+		}
+		cur[bestcpu]--;
+	}
+
+	kprintf("schedtrace: %s, last %u events\n",
+		schedtrace_enabled ? "on" : "off", n);
+
+	/* Then forwards from there, oldest first. */
+	while (1) {
+		best = NULL;
+		bestcpu = 0;
+		for (i=0; i<SCHEDTRACE_MAXCPUS; i++) {
+			if (cur[i] == hi[i]) {
+				continue;
+			}
+			sr = schedtrace_rings[i];
+			se = &sr->sr_events[cur[i] % SCHEDTRACE_SIZE];
+			if (best == NULL || se->se_time < best->se_time) {
+				best = se;
+				bestcpu = i;
+			}
+		}
+		if (best == NULL) {
+			break;
+		}
+		schedtrace_print(bestcpu, best);
+		cur[bestcpu]++;
+	}
+}
+
+/*
+ * Print the run queue latency histogram, and the CPU time each thread
+ * got according to the switchouts still in the rings.
+ */
+void
+schedtrace_summary(void)
+{
+	struct schedtrace_thread {
+		const struct thread *st_thread;
+		unsigned st_runs;
+		uint64_t st_ns;
+		char st_name[SCHEDTRACE_NAMELEN];
+	} *all, tmp;
+	unsigned latency[SCHEDTRACE_NBUCKETS];
+	struct schedtrace_ring *sr;
+	const struct schedtrace_event *se;
+	uint64_t idle, ran;
+	unsigned nall, lost, total, held, i, j, k;
+
+	COMPILE_ASSERT(SCHEDTRACE_MAXTHREADS * sizeof(*all) < 2048);
+	all = kmalloc(SCHEDTRACE_MAXTHREADS * sizeof(*all));
+	if (all == NULL) {
+		kprintf("schedtrace: Out of memory\n");
+		return;
+	}
+
+	bzero(latency, sizeof(latency));
+	total = 0;
+	nall = 0;
+	lost = 0;
+	kprintf("schedtrace: %s\n", schedtrace_enabled ? "on" : "off");
+	kprintf("cpu   events   ran(us)  idle(us)\n");
+	for (i=0; i<SCHEDTRACE_MAXCPUS; i++) {
+		sr = schedtrace_rings[i];
+		if (sr == NULL) {
+			continue;
+		}
+		for (j=0; j<SCHEDTRACE_NBUCKETS; j++) {
+			latency[j] += sr->sr_latency[j];
+			total += sr->sr_latency[j];
+		}
+
+		idle = ran = 0;
+		held = schedtrace_held(sr);
+		for (j=0; j<held; j++) {
+			se = &sr->sr_events[(sr->sr_count - held + j)
+					    % SCHEDTRACE_SIZE];
+			if (se->se_kind == SCHEDTRACE_UNIDLE) {
+				idle += se->se_ns;
+				continue;
+			}
+			if (se->se_kind != SCHEDTRACE_SWITCHOUT) {
+				continue;
+			}
+			ran += se->se_ns;
+			for (k=0; k<nall; k++) {
+				if (all[k].st_thread == se->se_thread &&
+				    !strcmp(all[k].st_name, se->se_name)) {
+					break;
+				}
+			}
+			if (k == nall) {
+				if (nall == SCHEDTRACE_MAXTHREADS) {
+					lost++;
+					continue;
+				}
+				all[k].st_thread = se->se_thread;
+				strcpy(all[k].st_name, se->se_name);
+				all[k].st_ns = 0;
+				all[k].st_runs = 0;
+				nall++;
+			}
+			all[k].st_ns += se->se_ns;
+			all[k].st_runs++;
+		}
+		kprintf("%3u %8u %9llu %9llu\n", i, sr->sr_count,
+			(unsigned long long)(ran / 1000),
+			(unsigned long long)(idle / 1000));
+	}
+
+	kprintf("\nrun queue latency, %u switches:\n", total);
+	for (i=0; i<SCHEDTRACE_NBUCKETS; i++) {
+		if (latency[i] == 0) {
+			continue;
+		}
+		if (i == 0) {
+			kprintf("         < 1us");
+		}
+		else if (i == SCHEDTRACE_NBUCKETS-1) {
+			kprintf("  >= %8uus", 1U << (i-1));
+		}
+		else {
+			kprintf("  < %8uus", 1U << i);
+		}
+		kprintf(" %9u\n", latency[i]);
+	}
+
+	/* Selection sort, most CPU time first. */
+	for (i=0; i<nall; i++) {
+		k = i;
+		for (j=i+1; j<nall; j++) {
+			if (all[j].st_ns > all[k].st_ns) {
+				k = j;
+			}
+		}
+		tmp = all[i];
+		all[i] = all[k];
+		all[k] = tmp;
+	}
+
+	kprintf("\nthread                 runs   cpu(us)\n");
+	for (i=0; i<nall; i++) {
+		kprintf("%-16s %10u %9llu\n", all[i].st_name, all[i].st_runs,
+			(unsigned long long)(all[i].st_ns / 1000));
+	}
+	if (lost > 0) {
+		kprintf("(%u switchouts from other threads not shown)\n", lost);
+	}
+
+	kfree(all);
+}
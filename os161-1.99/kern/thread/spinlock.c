@@ -36,6 +36,7 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
@@ -50,6 +51,9 @@ spinlock_init(struct spinlock *lk)
 {
 	spinlock_data_set(&lk->lk_lock, 0);
 	lk->lk_holder = NULL;
+#if OPT_LOCKSTAT
+	lk->lk_stattime = 0;
+#endif
 }
 
 /*
@@ -73,6 +77,9 @@ void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+#if OPT_LOCKSTAT
+	unsigned spins = 0;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -99,15 +106,28 @@ spinlock_acquire(struct spinlock *lk)
 		 * we don't.
 		 */
 		if (spinlock_data_get(&lk->lk_lock) != 0) {
+#if OPT_LOCKSTAT
+			spins++;
+#endif
 			continue;
 		}
 		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
+#if OPT_LOCKSTAT
+			spins++;
+#endif
 			continue;
 		}
 		break;
 	}
 
 	lk->lk_holder = mycpu;
+
+#if OPT_LOCKSTAT
+	if (lockstat_enabled) {
+		lockstat_acquired(lk, LOCKSTAT_SPINLOCK, NULL, spins, 0);
+		lk->lk_stattime = lockstat_now();
+	}
+#endif
 }
 
 /*
@@ -121,6 +141,15 @@ spinlock_release(struct spinlock *lk)
 		KASSERT(lk->lk_holder == curcpu->c_self);
 	}
 
+#if OPT_LOCKSTAT
+	if (lk->lk_stattime != 0) {
+		/* Even if lockstat was turned off meanwhile */
+		lockstat_released(lk, LOCKSTAT_SPINLOCK, NULL,
+				  lockstat_now() - lk->lk_stattime);
+		lk->lk_stattime = 0;
+	}
+#endif
+
 	lk->lk_holder = NULL;
 	spinlock_data_set(&lk->lk_lock, 0);
 	spllower(IPL_HIGH, IPL_NONE);
@@ -139,3 +168,94 @@ spinlock_do_i_hold(struct spinlock *lk)
 	/* Assume we can read lk_holder atomically enough for this to work */
 	return (lk->lk_holder == curcpu->c_self);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Ticket spinlocks.
+
+/*
+ * Initialize ticket lock.
+ */
+void
+ticketlock_init(struct ticketlock *lk)
+{
+	spinlock_data_set(&lk->tkl_next, 0);
+	spinlock_data_set(&lk->tkl_serving, 0);
+	lk->tkl_holder = NULL;
+}
+
+/*
+ * Clean up ticket lock.
+ */
+void
+ticketlock_cleanup(struct ticketlock *lk)
+{
+	KASSERT(lk->tkl_holder == NULL);
+	KASSERT(spinlock_data_get(&lk->tkl_next) ==
+		spinlock_data_get(&lk->tkl_serving));
+}
+
+/*
+ * Get the lock.
+ *
+ * As with spinlock_acquire, disable interrupts first. Then take a
+ * ticket and wait for our turn. The counters wrap, which is fine as
+ * long as there are fewer than 2^32 CPUs.
+ */
+void
+ticketlock_acquire(struct ticketlock *lk)
+{
+	struct cpu *mycpu;
+	spinlock_data_t ticket;
+
+	splraise(IPL_NONE, IPL_HIGH);
+
+	/* this must work before curcpu initialization */
+	if (CURCPU_EXISTS()) {
+		mycpu = curcpu->c_self;
+		if (lk->tkl_holder == mycpu) {
+			panic("Deadlock on ticketlock %p\n", lk);
+		}
+	}
+	else {
+		mycpu = NULL;
+	}
+
+	ticket = spinlock_data_fetchadd(&lk->tkl_next, 1);
+	while (spinlock_data_get(&lk->tkl_serving) != ticket) {
+		/* spin */
+	}
+
+	lk->tkl_holder = mycpu;
+}
+
+/*
+ * Release the lock. Only the holder writes tkl_serving, so this
+ * doesn't need to be atomic.
+ */
+void
+ticketlock_release(struct ticketlock *lk)
+{
+	/* this must work before curcpu initialization */
+	if (CURCPU_EXISTS()) {
+		KASSERT(lk->tkl_holder == curcpu->c_self);
+	}
+
+	lk->tkl_holder = NULL;
+	spinlock_data_set(&lk->tkl_serving,
+			  spinlock_data_get(&lk->tkl_serving) + 1);
+	spllower(IPL_HIGH, IPL_NONE);
+}
+
+/*
+ * Check if the current cpu holds the lock.
+ */
+bool
+ticketlock_do_i_hold(struct ticketlock *lk)
+{
+	if (!CURCPU_EXISTS()) {
+		return true;
+	}
+
+	return (lk->tkl_holder == curcpu->c_self);
+}
@@ -38,7 +38,9 @@
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
+#include <cpu.h>
 #include <synch.h>
+#include <lockstat.h>
 #include <opt-A1.h>
 
 ////////////////////////////////////////////////////////////
@@ -98,8 +100,17 @@ P(struct semaphore *sem) {
      */
     KASSERT(curthread->t_in_interrupt == false);
 
+#if OPT_LOCKSTAT
+    uint64_t waitstart = 0;
+#endif
+
     spinlock_acquire(&sem->sem_lock);
     while (sem->sem_count == 0) {
+#if OPT_LOCKSTAT
+        if (lockstat_enabled && waitstart == 0) {
+            waitstart = lockstat_now();
+        }
+#endif
         /*
          * Bridge to the wchan lock, so if someone else comes
          * along in V right this instant the wakeup can't go
@@ -125,6 +136,13 @@ P(struct semaphore *sem) {
     KASSERT(sem->sem_count > 0);
     sem->sem_count--;
     spinlock_release(&sem->sem_lock);
+
+#if OPT_LOCKSTAT
+    if (lockstat_enabled) {
+        lockstat_acquired(sem, LOCKSTAT_SEM, sem->sem_name, 0,
+                          waitstart != 0 ? lockstat_now() - waitstart : 0);
+    }
+#endif
 }
 
 void
@@ -144,6 +162,38 @@ V(struct semaphore *sem) {
 //
 // Lock.
 
+#if OPT_A1
+/*
+ * How long to spin on a lock whose holder is running on another CPU
+ * before giving up and sleeping. A context switch each way costs a
+ * few thousand cycles, so spinning a bit less than that is a win
+ * whenever critical sections are short.
+ */
+#define LOCK_SPINLIMIT 1000
+
+unsigned lock_spinlimit = LOCK_SPINLIMIT;
+
+/*
+ * Is the holder of LOCK running on another CPU? If so, it'll probably
+ * release the lock soon. This is only a hint: we look at the CPU the
+ * holder acquired the lock on (CPUs are never freed, unlike threads),
+ * so if the holder has since migrated we just sleep.
+ */
+static
+bool
+lock_holder_running(struct lock *lock)
+{
+    struct cpu *c = lock->lk_holdercpu;
+    struct thread *holder = lock->lk_curthread;
+
+    if (c == NULL || holder == NULL || c == curcpu->c_self) {
+        return false;
+    }
+    /* c_curthread is not volatile; make sure we really reread it */
+    return *(struct thread *volatile *)&c->c_curthread == holder;
+}
+#endif
+
 struct lock *
 lock_create(const char *name) {
     // add stuff here as needed
@@ -172,6 +222,13 @@ lock_create(const char *name) {
 
     spinlock_init(&lock->lk_lock);
     lock->lk_value = initial_count;
+    lock->lk_curthread = NULL;
+    lock->lk_holdercpu = NULL;
+    lock->lk_sleepers = 0;
+    lock->lk_handoff = false;
+#if OPT_LOCKSTAT
+    lock->lk_stattime = 0;
+#endif
 
     return lock;
 
@@ -226,21 +283,65 @@ lock_acquire(struct lock *lock) {
      * complete the P without blocking.
      */
     KASSERT(curthread->t_in_interrupt == false);
+    KASSERT(lock->lk_curthread != curthread);
 
+    unsigned spins = 0;
+#if OPT_LOCKSTAT
+    uint64_t waitstart = 0;
+#endif
 
     spinlock_acquire(&lock->lk_lock);
     while (lock->lk_value == 0) {
-
+        /*
+         * If the holder is running elsewhere, spin (without the
+         * spinlock, so it can get in to release) until it lets go,
+         * stops running, or we run out of patience.
+         */
+        if (spins < lock_spinlimit && lock_holder_running(lock)) {
+            spinlock_release(&lock->lk_lock);
+            while (lock->lk_value == 0 && spins < lock_spinlimit &&
+                   lock_holder_running(lock)) {
+                spins++;
+            }
+            spinlock_acquire(&lock->lk_lock);
+            continue;
+        }
+
+#if OPT_LOCKSTAT
+        if (lockstat_enabled && waitstart == 0) {
+            waitstart = lockstat_now();
+        }
+#endif
+        lock->lk_sleepers++;
         wchan_lock(lock->lk_wchan);
         spinlock_release(&lock->lk_lock);
         wchan_sleep(lock->lk_wchan);
 
         spinlock_acquire(&lock->lk_lock);
+        lock->lk_sleepers--;
+        if (lock->lk_handoff) {
+            /* lock_release passed it straight to us. */
+            lock->lk_handoff = false;
+            break;
+        }
+    }
+    if (lock->lk_value == 1) {
+        lock->lk_value = 0;
     }
-    KASSERT(lock->lk_value == 1);
-    lock->lk_value = 0;
+    KASSERT(lock->lk_value == 0);
     lock->lk_curthread = curthread;
+    lock->lk_holdercpu = curcpu->c_self;
     spinlock_release(&lock->lk_lock);
+
+#if OPT_LOCKSTAT
+    if (lockstat_enabled) {
+        uint64_t now = lockstat_now();
+
+        lockstat_acquired(lock, LOCKSTAT_LOCK, lock->lk_name, spins,
+                          waitstart != 0 ? now - waitstart : 0);
+        lock->lk_stattime = now;
+    }
+#endif
 #else
 
 #endif
@@ -253,10 +354,30 @@ lock_release(struct lock *lock) {
     KASSERT(lock != NULL);
 
 
+#if OPT_LOCKSTAT
+    if (lock->lk_curthread == curthread && lock->lk_stattime != 0) {
+        lockstat_released(lock, LOCKSTAT_LOCK, lock->lk_name,
+                          lockstat_now() - lock->lk_stattime);
+        lock->lk_stattime = 0;
+    }
+#endif
+
     spinlock_acquire(&lock->lk_lock);
     if (lock->lk_curthread == curthread){
-        lock->lk_value = 1;
-        KASSERT(lock->lk_value == 1);
+        lock->lk_curthread = NULL;
+        lock->lk_holdercpu = NULL;
+        KASSERT(!lock->lk_handoff);
+        if (lock->lk_sleepers > 0) {
+            /*
+             * Hand off: leave the lock held and let the thread we
+             * wake take it, so that spinners and new arrivals
+             * can't keep barging in ahead of it.
+             */
+            lock->lk_handoff = true;
+        }
+        else {
+            lock->lk_value = 1;
+        }
         wchan_wakeone(lock->lk_wchan);
     }
     spinlock_release(&lock->lk_lock);
@@ -339,3 +460,136 @@ cv_broadcast(struct cv *cv, struct lock *lock) {
     (void) cv;    // suppress warning until code gets written
     (void) lock;  // suppress warning until code gets written
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name) {
+    struct rwlock *rwlock;
+
+    rwlock = kmalloc(sizeof(struct rwlock));
+    if (rwlock == NULL) {
+        return NULL;
+    }
+
+    rwlock->rwlock_name = kstrdup(name);
+    if (rwlock->rwlock_name == NULL) {
+        kfree(rwlock);
+        return NULL;
+    }
+
+    rwlock->rwlock_rwchan = wchan_create(rwlock->rwlock_name);
+    if (rwlock->rwlock_rwchan == NULL) {
+        kfree(rwlock->rwlock_name);
+        kfree(rwlock);
+        return NULL;
+    }
+
+    rwlock->rwlock_wwchan = wchan_create(rwlock->rwlock_name);
+    if (rwlock->rwlock_wwchan == NULL) {
+        wchan_destroy(rwlock->rwlock_rwchan);
+        kfree(rwlock->rwlock_name);
+        kfree(rwlock);
+        return NULL;
+    }
+
+    spinlock_init(&rwlock->rwlock_lock);
+    rwlock->rwlock_readers = 0;
+    rwlock->rwlock_wwaiting = 0;
+    rwlock->rwlock_writer = NULL;
+
+    return rwlock;
+}
+
+void
+rwlock_destroy(struct rwlock *rwlock) {
+    KASSERT(rwlock != NULL);
+    KASSERT(rwlock->rwlock_readers == 0);
+    KASSERT(rwlock->rwlock_writer == NULL);
+
+    /* wchan_cleanup will assert if anyone's waiting on it */
+    spinlock_cleanup(&rwlock->rwlock_lock);
+    wchan_destroy(rwlock->rwlock_wwchan);
+    wchan_destroy(rwlock->rwlock_rwchan);
+    kfree(rwlock->rwlock_name);
+    kfree(rwlock);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rwlock) {
+    KASSERT(rwlock != NULL);
+    KASSERT(curthread->t_in_interrupt == false);
+
+    spinlock_acquire(&rwlock->rwlock_lock);
+    /* Wait behind writers, including ones only waiting (see synch.h). */
+    while (rwlock->rwlock_writer != NULL || rwlock->rwlock_wwaiting > 0) {
+        KASSERT(rwlock->rwlock_writer != curthread);
+        wchan_lock(rwlock->rwlock_rwchan);
+        spinlock_release(&rwlock->rwlock_lock);
+        wchan_sleep(rwlock->rwlock_rwchan);
+
+        spinlock_acquire(&rwlock->rwlock_lock);
+    }
+    rwlock->rwlock_readers++;
+    spinlock_release(&rwlock->rwlock_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rwlock) {
+    KASSERT(rwlock != NULL);
+
+    spinlock_acquire(&rwlock->rwlock_lock);
+    KASSERT(rwlock->rwlock_readers > 0);
+    rwlock->rwlock_readers--;
+    if (rwlock->rwlock_readers == 0 && rwlock->rwlock_wwaiting > 0) {
+        wchan_wakeone(rwlock->rwlock_wwchan);
+    }
+    spinlock_release(&rwlock->rwlock_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rwlock) {
+    KASSERT(rwlock != NULL);
+    KASSERT(curthread->t_in_interrupt == false);
+    KASSERT(rwlock->rwlock_writer != curthread);
+
+    spinlock_acquire(&rwlock->rwlock_lock);
+    rwlock->rwlock_wwaiting++;
+    while (rwlock->rwlock_writer != NULL || rwlock->rwlock_readers > 0) {
+        wchan_lock(rwlock->rwlock_wwchan);
+        spinlock_release(&rwlock->rwlock_lock);
+        wchan_sleep(rwlock->rwlock_wwchan);
+
+        spinlock_acquire(&rwlock->rwlock_lock);
+    }
+    rwlock->rwlock_wwaiting--;
+    rwlock->rwlock_writer = curthread;
+    spinlock_release(&rwlock->rwlock_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rwlock) {
+    KASSERT(rwlock != NULL);
+
+    spinlock_acquire(&rwlock->rwlock_lock);
+    KASSERT(rwlock->rwlock_writer == curthread);
+    rwlock->rwlock_writer = NULL;
+    if (rwlock->rwlock_wwaiting > 0) {
+        wchan_wakeone(rwlock->rwlock_wwchan);
+    }
+    else {
+        /* Let all the waiting readers in at once. */
+        wchan_wakeall(rwlock->rwlock_rwchan);
+    }
+    spinlock_release(&rwlock->rwlock_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rwlock) {
+    KASSERT(rwlock != NULL);
+
+    /* Only we can make this true or, if it is, false. */
+    return rwlock->rwlock_writer == curthread;
+}
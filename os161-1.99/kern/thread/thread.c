@@ -50,13 +50,45 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <clock.h>
+#include <lockstat.h>
+#include <schedtrace.h>
+#include <syscallstat.h>
 
 #include "opt-synchprobs.h"
+#include "opt-fairsched.h"
+#include "opt-schedtrace.h"
+#include "opt-syscallstat.h"
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/*
+ * Length of a time slice, in hardclocks, at priority level PRIO.
+ * Lower-priority (CPU-bound) threads run less often but for longer.
+ */
+#define SCHED_QUANTUM(prio)	(1U << (prio))
+
+#if OPT_FAIRSCHED
+/*
+ * Fair-share scheduling constants. Virtual run time is counted in
+ * 1/SCHED_FAIR_TICK hardclocks of a single-threaded process of the
+ * default weight. A thread is preempted once it gets SCHED_FAIR_SLICE
+ * ahead of the next thread, and runs at most SCHED_FAIR_MAXPERIOD
+ * hardclocks between ticks.
+ */
+#define SCHED_FAIR_TICK		1024
+#define SCHED_FAIR_SLICE	(2 * SCHED_FAIR_TICK)
+#define SCHED_FAIR_MAXPERIOD	8
+#endif
+
+/*
+ * At most this many dead threads (with their stacks) are kept on
+ * each cpu for reuse; see "Thread cache" below.
+ */
+#define THREAD_CACHE_MAX	8
+
 /* Wait channel. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -72,6 +104,10 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* Load balancing; see "Thread migration" below. */
+static struct thread *thread_steal(unsigned minwaiting);
+static void thread_kick_idle(struct cpu *busy);
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -111,9 +147,80 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Thread cache.
+ *
+ * Instead of freeing exited threads, exorcise keeps up to
+ * THREAD_CACHE_MAX of them on the cpu's c_threadcache, still with
+ * their stacks (and the stack magic from thread_checkstack_init), so
+ * that creating a thread usually doesn't need the allocator. The
+ * cache is per-cpu and only touched by its own cpu, so all it needs
+ * is interrupts off.
+ */
+
+/*
+ * Get a thread from the current cpu's cache, or NULL if it's empty.
+ * The thread has a stack, and nothing else is initialized.
+ */
+static
+struct thread *
+thread_cache_get(void)
+{
+	struct thread *thread;
+	int spl;
+
+	if (!CURCPU_EXISTS()) {
+		/* Too early in boot. */
+		return NULL;
+	}
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	splx(spl);
+
+	if (thread != NULL) {
+		thread_checkstack(thread);
+	}
+	return thread;
+}
+
+/*
+ * Put a dead thread into the current cpu's cache instead of
+ * destroying it, if there's room. Returns false if there isn't, or if
+ * the thread isn't worth keeping because it has no stack. Interrupts
+ * must be off.
+ */
+static
+bool
+thread_cache_put(struct thread *thread)
+{
+	KASSERT(curthread->t_curspl > 0);
+	KASSERT(thread != curthread);
+	KASSERT(thread->t_state != S_RUN);
+
+	if (thread->t_stack == NULL ||
+	    curcpu->c_threadcache.tl_count >= THREAD_CACHE_MAX) {
+		return false;
+	}
+
+	/* Same as thread_destroy, except for the stack. */
+	KASSERT(thread->t_proc == NULL);
+	thread_checkstack(thread);
+	thread_machdep_cleanup(&thread->t_machdep);
+	thread->t_wchan_name = "CACHED";
+	kfree(thread->t_name);
+	thread->t_name = NULL;
+
+	threadlist_addhead(&curcpu->c_threadcache, thread);
+	return true;
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
+ *
+ * If the thread comes from the thread cache it already has a stack;
+ * otherwise t_stack is NULL and the caller should allocate one.
  */
 static
 struct thread *
@@ -123,13 +230,20 @@ thread_create(const char *name)
 
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
+	thread = thread_cache_get();
 	if (thread == NULL) {
-		return NULL;
+		thread = kmalloc(sizeof(*thread));
+		if (thread == NULL) {
+			return NULL;
+		}
+		thread->t_stack = NULL;
 	}
 
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
+		if (thread->t_stack != NULL) {
+			kfree(thread->t_stack);
+		}
 		kfree(thread);
 		return NULL;
 	}
@@ -139,11 +253,18 @@ thread_create(const char *name)
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
 
+	/* Scheduler fields; new threads start at the top priority */
+	thread->t_priority = 0;
+	thread->t_quantum = SCHED_QUANTUM(0);
+	thread->t_vruntime = 0;
+	thread->t_vrelative = false;
+	thread->t_readytime = 0;
+	thread->t_oncputime = 0;
+
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
 	thread->t_curspl = IPL_HIGH;
@@ -166,7 +287,7 @@ struct cpu *
 cpu_create(unsigned hardware_number)
 {
 	struct cpu *c;
-	int result;
+	int result, i;
 	char namebuf[16];
 
 	c = kmalloc(sizeof(*c));
@@ -179,11 +300,21 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadcache);
 	c->c_hardclocks = 0;
+	c->c_hardclock_period = 1;
+	c->c_stealseed = 0x9e3779b9 ^ hardware_number;
+	c->c_wake_prev = 0;
+	c->c_wake_idle = 0;
+	c->c_wake_waker = 0;
 
 	c->c_isidle = false;
-	threadlist_init(&c->c_runqueue);
-	spinlock_init(&c->c_runqueue_lock);
+	for (i=0; i<SCHED_NPRIO; i++) {
+		threadlist_init(&c->c_runqueue[i]);
+	}
+	c->c_runqueue_hint = 0;
+	c->c_minvruntime = 0;
+	ticketlock_init(&c->c_runqueue_lock);
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
@@ -194,6 +325,16 @@ cpu_create(unsigned hardware_number)
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
 
+#if OPT_LOCKSTAT
+	lockstat_cpu_init(c);
+#endif
+#if OPT_SCHEDTRACE
+	schedtrace_cpu_init(c);
+#endif
+#if OPT_SYSCALLSTAT
+	syscallstat_cpu_init(c);
+#endif
+
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
 	if (c->c_curthread == NULL) {
@@ -213,7 +354,7 @@ cpu_create(unsigned hardware_number)
 		 */
 		/*c->c_curthread->t_stack = ... */
 	}
-	else {
+	else if (c->c_curthread->t_stack == NULL) {
 		c->c_curthread->t_stack = kmalloc(STACK_SIZE);
 		if (c->c_curthread->t_stack == NULL) {
 			panic("cpu_create: couldn't allocate stack");
@@ -277,7 +418,9 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (!thread_cache_put(z)) {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -289,6 +432,8 @@ exorcise(void)
 void
 thread_panic(void)
 {
+	int i;
+
 	/*
 	 * Kill off other CPUs.
 	 *
@@ -303,9 +448,12 @@ thread_panic(void)
 	 * to.  Instead, blat the list structure by hand, and take the
 	 * risk that it might not be quite atomic.
 	 */
-	curcpu->c_runqueue.tl_count = 0;
-	curcpu->c_runqueue.tl_head.tln_next = NULL;
-	curcpu->c_runqueue.tl_tail.tln_prev = NULL;
+	for (i=0; i<SCHED_NPRIO; i++) {
+		curcpu->c_runqueue[i].tl_count = 0;
+		curcpu->c_runqueue[i].tl_head.tln_next = NULL;
+		curcpu->c_runqueue[i].tl_tail.tln_prev = NULL;
+	}
+	curcpu->c_runqueue_hint = 0;
 
 	/*
 	 * Ideally, we want to make sure sleeping threads don't wake
@@ -426,6 +574,212 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Run queue handling.
+ *
+ * Each cpu has one run queue per priority level. Threads go on the
+ * tail of the queue for their current priority and come off the head
+ * of the highest-priority nonempty queue. All of these must be called
+ * with the cpu's run queue lock held.
+ *
+ * c_runqueue_hint is kept equal to the total number of queued threads
+ * so other cpus can find work to steal without taking our lock.
+ */
+#if OPT_FAIRSCHED
+/*
+ * With fair-share scheduling (see "Scheduler" below) all threads stay
+ * at priority 0, and that queue is kept sorted by t_vruntime, so the
+ * head is the thread that has had the least cpu for its share.
+ *
+ * A thread coming onto the queue is brought up to no more than one
+ * slice behind c_minvruntime, so a thread that has been asleep for a
+ * long time (or a new one) gets to go soon but can't then monopolize
+ * the cpu catching up.
+ *
+ * Each cpu's c_minvruntime moves at its own pace, so a t_vruntime
+ * only means something on the cpu it was earned on. A thread moving
+ * to another cpu has the source's c_minvruntime taken off while the
+ * source's run queue is locked (runqueue_fair_leave), and the
+ * destination's added when it gets there (runqueue_fair_arrive), so
+ * it keeps its place relative to the other threads. Being behind is
+ * forgiven along the way, as it would be on insert anyway.
+ */
+static
+void
+runqueue_fair_leave(struct cpu *c, struct thread *t)
+{
+	KASSERT(ticketlock_do_i_hold(&c->c_runqueue_lock));
+	KASSERT(!t->t_vrelative);
+	if (t->t_vruntime > c->c_minvruntime) {
+		t->t_vruntime -= c->c_minvruntime;
+	}
+	else {
+		t->t_vruntime = 0;
+	}
+	t->t_vrelative = true;
+}
+
+static
+void
+runqueue_fair_arrive(struct cpu *c, struct thread *t)
+{
+	if (t->t_vrelative) {
+		t->t_vruntime += c->c_minvruntime;
+		t->t_vrelative = false;
+	}
+}
+
+static
+void
+runqueue_fair_insert(struct cpu *c, struct thread *t)
+{
+	struct thread *t2;
+
+	runqueue_fair_arrive(c, t);
+	if (t->t_vruntime + SCHED_FAIR_SLICE < c->c_minvruntime) {
+		t->t_vruntime = c->c_minvruntime - SCHED_FAIR_SLICE;
+	}
+	THREADLIST_FORALL(t2, c->c_runqueue[0]) {
+		if (t2->t_vruntime > t->t_vruntime) {
+			threadlist_insertbefore(&c->c_runqueue[0], t, t2);
+			return;
+		}
+	}
+	threadlist_addtail(&c->c_runqueue[0], t);
+}
+#endif
+
+static
+void
+runqueue_add(struct cpu *c, struct thread *t)
+{
+	KASSERT(ticketlock_do_i_hold(&c->c_runqueue_lock));
+	KASSERT(t->t_priority >= 0 && t->t_priority < SCHED_NPRIO);
+#if OPT_FAIRSCHED
+	runqueue_fair_insert(c, t);
+#else
+	threadlist_addtail(&c->c_runqueue[t->t_priority], t);
+#endif
+	c->c_runqueue_hint++;
+}
+
+static
+struct thread *
+runqueue_remhead(struct cpu *c)
+{
+	struct thread *t;
+	int i;
+
+	KASSERT(ticketlock_do_i_hold(&c->c_runqueue_lock));
+	for (i=0; i<SCHED_NPRIO; i++) {
+		t = threadlist_remhead(&c->c_runqueue[i]);
+		if (t != NULL) {
+			c->c_runqueue_hint--;
+			return t;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Take a thread off the end of the run queues, lowest priority first.
+ * This is the thread that will be waiting the longest anyway, so it is
+ * the best candidate for moving elsewhere.
+ */
+static
+struct thread *
+runqueue_remtail(struct cpu *c)
+{
+	struct thread *t;
+	int i;
+
+	KASSERT(ticketlock_do_i_hold(&c->c_runqueue_lock));
+	for (i=SCHED_NPRIO-1; i>=0; i--) {
+		t = threadlist_remtail(&c->c_runqueue[i]);
+		if (t != NULL) {
+			c->c_runqueue_hint--;
+			return t;
+		}
+	}
+	return NULL;
+}
+
+static
+unsigned
+runqueue_count(struct cpu *c)
+{
+	unsigned count;
+	int i;
+
+	KASSERT(ticketlock_do_i_hold(&c->c_runqueue_lock));
+	count = 0;
+	for (i=0; i<SCHED_NPRIO; i++) {
+		count += c->c_runqueue[i].tl_count;
+	}
+	return count;
+}
+
+/*
+ * Return the best (numerically lowest) priority of any queued thread,
+ * or SCHED_NPRIO if nothing is queued.
+ */
+static
+int
+runqueue_bestprio(struct cpu *c)
+{
+	int i;
+
+	KASSERT(ticketlock_do_i_hold(&c->c_runqueue_lock));
+	for (i=0; i<SCHED_NPRIO; i++) {
+		if (!threadlist_isempty(&c->c_runqueue[i])) {
+			break;
+		}
+	}
+	return i;
+}
+
+/*
+ * Let TARGETCPU know that threads were just added to its run queue.
+ * ISIDLE is whether it was idle beforehand. Call with its run queue
+ * lock held.
+ */
+static
+void
+thread_notify_cpu(struct cpu *targetcpu, bool isidle)
+{
+	KASSERT(ticketlock_do_i_hold(&targetcpu->c_runqueue_lock));
+
+	if (isidle) {
+		/*
+		 * Other processor is idle; send interrupt to make
+		 * sure it unidles.
+		 */
+		ipi_send(targetcpu, IPI_UNIDLE);
+	}
+	else {
+		/*
+		 * Target is busy, so the thread has to wait; see if
+		 * some idle cpu can take it instead.
+		 */
+		thread_kick_idle(targetcpu);
+
+		/*
+		 * If the target stopped ticking because it had nothing
+		 * else to run, it needs its tick back to get around to
+		 * this thread. (Unlocked peek; c_hardclock_period
+		 * belongs to the target cpu.)
+		 */
+		if (targetcpu->c_hardclock_period != 1) {
+			if (targetcpu == curcpu->c_self) {
+				hardclock_setperiod(1);
+			}
+			else {
+				ipi_send(targetcpu, IPI_UNIDLE);
+			}
+		}
+	}
+}
+
 /*
  * Make a thread runnable.
  *
@@ -443,44 +797,44 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 
 	if (already_have_lock) {
 		/* The target thread's cpu should be already locked. */
-		KASSERT(spinlock_do_i_hold(&targetcpu->c_runqueue_lock));
+		KASSERT(ticketlock_do_i_hold(&targetcpu->c_runqueue_lock));
 	}
 	else {
-		spinlock_acquire(&targetcpu->c_runqueue_lock);
+		ticketlock_acquire(&targetcpu->c_runqueue_lock);
 	}
 
 	isidle = targetcpu->c_isidle;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
-	if (isidle) {
-		/*
-		 * Other processor is idle; send interrupt to make
-		 * sure it unidles.
-		 */
-		ipi_send(targetcpu, IPI_UNIDLE);
+	runqueue_add(targetcpu, target);
+#if OPT_SCHEDTRACE
+	if (schedtrace_enabled) {
+		schedtrace_wakeup(target, targetcpu);
 	}
+#endif
+	thread_notify_cpu(targetcpu, isidle);
 
 	if (!already_have_lock) {
-		spinlock_release(&targetcpu->c_runqueue_lock);
+		ticketlock_release(&targetcpu->c_runqueue_lock);
 	}
 }
 
 /*
- * Create a new thread based on an existing one.
- *
- * The new thread has name NAME, and starts executing in function
- * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
- *
- * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * Common code for thread_fork and thread_fork_frame: create a thread
+ * named NAME in process PROC (or the caller's) to run on cpu CPU. If
+ * FRAMELEN isn't 0, FRAMELEN bytes at FRAME are copied onto the top
+ * of the new thread's stack and the copy is passed as DATA1.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_common(const char *name,
+		   struct proc *proc,
+		   struct cpu *cpu,
+		   void (*entrypoint)(void *data1, unsigned long data2),
+		   void *data1,
+		   const void *frame, size_t framelen,
+		   unsigned long data2)
 {
 	struct thread *newthread;
+	size_t reserve;
 	int result;
 
 #ifdef UW
@@ -492,20 +846,22 @@ thread_fork(const char *name,
 		return ENOMEM;
 	}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
+	/* Allocate a stack, unless it came with one from the cache */
 	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
 	 */
 
 	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_cpu = cpu;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -525,15 +881,98 @@ thread_fork(const char *name,
 	 */
 	newthread->t_iplhigh_count++;
 
+	/* Copy the frame, if any, keeping the stack 8-byte aligned */
+	reserve = ROUNDUP(framelen, 8);
+	KASSERT(reserve <= STACK_SIZE / 4);
+	if (framelen > 0) {
+		data1 = (char *)newthread->t_stack + STACK_SIZE - reserve;
+		memcpy(data1, frame, framelen);
+	}
+
 	/* Set up the switchframe so entrypoint() gets called */
-	switchframe_init(newthread, entrypoint, data1, data2);
+	switchframe_init(newthread, reserve, entrypoint, data1, data2);
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
+	/* Lock the target cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
 
 	return 0;
 }
 
+/*
+ * Create a new thread based on an existing one.
+ *
+ * The new thread has name NAME, and starts executing in function
+ * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
+ *
+ * The new thread is created in the process P. If P is null, the
+ * process is inherited from the caller. It will start on the same CPU
+ * as the caller, unless the scheduler intervenes first.
+ */
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	return thread_fork_common(name, proc, curthread->t_cpu, entrypoint,
+				  data1, NULL, 0, data2);
+}
+
+/*
+ * Pick a cpu for a thread that has nothing cached anywhere yet: an
+ * idle one if there is one, otherwise the one with the fewest threads
+ * waiting, preferring the caller's on ties. Unlocked peeks at
+ * c_isidle and c_runqueue_hint, as in thread_kick_idle; being wrong
+ * only costs some balance.
+ */
+static
+struct cpu *
+thread_fork_place(void)
+{
+	struct cpu *best, *c;
+	unsigned numcpus, i;
+
+	best = curcpu->c_self;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=1; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, (curcpu->c_number + i) % numcpus);
+		if (c->c_isidle) {
+			return c;
+		}
+		if (c->c_runqueue_hint < best->c_runqueue_hint) {
+			best = c;
+		}
+	}
+	return best;
+}
+
+/*
+ * Like thread_fork, but copy FRAMELEN bytes at FRAME (say, a
+ * trapframe) onto the top of the new thread's own stack and pass
+ * ENTRYPOINT a pointer to the copy as DATA1. This saves allocating
+ * the data separately and saves the caller waiting for the new thread
+ * to copy it.
+ *
+ * The thread starts on cpu CPU. If that's NULL, it goes on the least
+ * busy cpu, which suits the first thread of a new process that has
+ * no particular reason to stay near its parent.
+ */
+int
+thread_fork_frame(const char *name,
+		  struct proc *proc,
+		  struct cpu *cpu,
+		  void (*entrypoint)(void *data1, unsigned long data2),
+		  const void *frame, size_t framelen,
+		  unsigned long data2)
+{
+	KASSERT(framelen > 0);
+	if (cpu == NULL) {
+		cpu = thread_fork_place();
+	}
+	return thread_fork_common(name, proc, cpu, entrypoint, NULL,
+				  frame, framelen, data2);
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -571,11 +1010,16 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	thread_checkstack(cur);
 
 	/* Lock the run queue. */
-	spinlock_acquire(&curcpu->c_runqueue_lock);
+	ticketlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
-		spinlock_release(&curcpu->c_runqueue_lock);
+	/*
+	 * Micro-optimization: if nothing to do, just return. When
+	 * yielding, that includes the case where everything waiting
+	 * has lower priority than we do.
+	 */
+	if (newstate == S_READY &&
+	    runqueue_bestprio(curcpu->c_self) > cur->t_priority) {
+		ticketlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
 	}
@@ -613,10 +1057,12 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	cur->t_state = newstate;
 
 	/*
-	 * Get the next thread. While there isn't one, call md_idle().
+	 * Get the next thread. While there isn't one, try to steal
+	 * one from another cpu, and failing that call md_idle().
 	 * curcpu->c_isidle must be true when md_idle is
 	 * called. Unlock the runqueue while idling too, to make sure
-	 * things can be added to it.
+	 * things can be added to it. (And while stealing, so we never
+	 * hold two run queue locks at once.)
 	 *
 	 * Note that we don't need to unlock the runqueue atomically
 	 * with idling; becoming unidle requires receiving an
@@ -632,14 +1078,36 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
-		next = threadlist_remhead(&curcpu->c_runqueue);
+		next = runqueue_remhead(curcpu->c_self);
 		if (next == NULL) {
-			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
-			spinlock_acquire(&curcpu->c_runqueue_lock);
+			ticketlock_release(&curcpu->c_runqueue_lock);
+			next = thread_steal(1);
+			if (next == NULL) {
+				/* No ticks while idle; see clock.c. */
+				hardclock_setperiod(0);
+#if OPT_SCHEDTRACE
+				if (schedtrace_enabled) {
+					schedtrace_idle(true);
+				}
+#endif
+				cpu_idle();
+#if OPT_SCHEDTRACE
+				if (schedtrace_enabled) {
+					schedtrace_idle(false);
+				}
+#endif
+			}
+			ticketlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
+	hardclock_setperiod(1);
+
+#if OPT_SCHEDTRACE
+	if (schedtrace_enabled) {
+		schedtrace_switch(cur, next, newstate);
+	}
+#endif
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -706,7 +1174,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	cur->t_state = S_RUN;
 
 	/* Unlock the run queue. */
-	spinlock_release(&curcpu->c_runqueue_lock);
+	ticketlock_release(&curcpu->c_runqueue_lock);
 
 	/* Activate our address space in the MMU. */
 	as_activate();
@@ -739,7 +1207,7 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	cur->t_state = S_RUN;
 
 	/* Release the runqueue lock acquired in thread_switch. */
-	spinlock_release(&curcpu->c_runqueue_lock);
+	ticketlock_release(&curcpu->c_runqueue_lock);
 
 	/* Activate our address space in the MMU. */
 	as_activate();
@@ -822,25 +1290,248 @@ thread_yield(void)
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is a multilevel feedback queue. Threads start at priority 0,
+ * the highest. A thread that uses up its whole time slice is demoted
+ * one level (see thread_tick), and each level down gets a longer
+ * slice (SCHED_QUANTUM). A thread that sleeps and is woken up is
+ * promoted one level (see thread_wakeup_boost), so threads that spend
+ * their time waiting for I/O or for each other stay near the top and
+ * get the cpu promptly when they want it, while CPU hogs sink to the
+ * bottom and soak up whatever is left.
+ *
+ * To keep the hogs from starving entirely, schedule() is called
+ * periodically from hardclock() and boosts everything on this cpu
+ * back to the top level.
+ *
+ * With options fairsched, there is instead a fair-share scheduler.
+ * Each thread accumulates virtual run time as it runs, at a rate
+ * inversely proportional to its process's share: the process's
+ * weight (p_weight, set with setpriority) divided by its number of
+ * running user threads, so a process doesn't get more cpu by having
+ * more threads. Each cpu runs the queued thread with the least
+ * virtual run time (see runqueue_fair_insert), and the current thread
+ * is preempted once it gets a slice ahead of that. There are no
+ * priority levels and so no boosting.
+ */
+
+#if OPT_FAIRSCHED
+
+/*
+ * Virtual run time charged to T per hardclock.
+ */
+static
+uint64_t
+thread_fair_rate(struct thread *t)
+{
+	struct proc *p;
+	unsigned weight, nthreads;
+
+	/* Exiting threads may have left their process already. */
+	p = t->t_proc;
+	weight = (p != NULL) ? p->p_weight : PROC_WEIGHT_DEFAULT;
+	nthreads = (p != NULL) ? p->p_nuthreads : 1;
+	if (nthreads == 0) {
+		/* Kernel threads aren't counted. */
+		nthreads = 1;
+	}
+	KASSERT(weight > 0);
+	return (uint64_t)SCHED_FAIR_TICK * PROC_WEIGHT_DEFAULT * nthreads
+		/ weight;
+}
+
+/*
+ * Charge the current thread for TICKS hardclocks. Called from
+ * hardclock().
+ */
+void
+thread_tick(unsigned ticks)
+{
+	struct thread *cur, *next;
+	uint64_t rate, min;
+	unsigned period;
+	bool preempt;
+
+	/* Nothing to charge if we interrupted the idle loop. */
+	if (curcpu->c_isidle) {
+		return;
+	}
+
+	cur = curthread;
+	rate = thread_fair_rate(cur);
+
+	ticketlock_acquire(&curcpu->c_runqueue_lock);
+	cur->t_vruntime += rate * ticks;
+
+	if (threadlist_isempty(&curcpu->c_runqueue[0])) {
+		next = NULL;
+	}
+	else {
+		next = curcpu->c_runqueue[0].tl_head.tln_next->tln_self;
+	}
+
+	/* Move the low-water mark along. It never goes backwards. */
+	min = cur->t_vruntime;
+	if (next != NULL && next->t_vruntime < min) {
+		min = next->t_vruntime;
+	}
+	if (min > curcpu->c_minvruntime) {
+		curcpu->c_minvruntime = min;
+	}
+
+	if (next == NULL) {
+		/*
+		 * Nothing else to run, so no need to tick often.
+		 * Anything made runnable here turns the tick back on.
+		 */
+		preempt = false;
+		period = SCHED_FAIR_MAXPERIOD;
+	}
+	else if (cur->t_vruntime >= next->t_vruntime + SCHED_FAIR_SLICE) {
+		preempt = true;
+		period = 1;
+	}
+	else {
+		/* Come back about when we'll be a slice ahead. */
+		preempt = false;
+		period = DIVROUNDUP(next->t_vruntime + SCHED_FAIR_SLICE
+				    - cur->t_vruntime, rate);
+		if (period > SCHED_FAIR_MAXPERIOD) {
+			period = SCHED_FAIR_MAXPERIOD;
+		}
+	}
+	hardclock_setperiod(period);
+	ticketlock_release(&curcpu->c_runqueue_lock);
+
+	if (preempt) {
+		thread_yield();
+	}
+}
+
+/*
+ * Nothing to do for a thread being woken up; runqueue_fair_insert
+ * deals with how long it was asleep.
  */
+static
+void
+thread_wakeup_boost(struct thread *target)
+{
+	(void)target;
+}
 
+/*
+ * No priority levels, so nothing to do periodically either.
+ */
 void
 schedule(void)
 {
+}
+
+#else /* not OPT_FAIRSCHED */
+
+/*
+ * Charge the current thread for a hardclock. Called from hardclock().
+ */
+void
+thread_tick(unsigned ticks)
+{
+	struct thread *cur;
+	bool preempt;
+	unsigned period;
+
+	/* Nothing to charge if we interrupted the idle loop. */
+	if (curcpu->c_isidle) {
+		return;
+	}
+
+	cur = curthread;
+
+	ticketlock_acquire(&curcpu->c_runqueue_lock);
+	KASSERT(cur->t_quantum > 0);
+	cur->t_quantum -= (ticks < cur->t_quantum) ? ticks : cur->t_quantum;
+	if (cur->t_quantum == 0) {
+		/* Used up its time slice; demote it. */
+		if (cur->t_priority < SCHED_NPRIO - 1) {
+			cur->t_priority++;
+		}
+		cur->t_quantum = SCHED_QUANTUM(cur->t_priority);
+		/* Let anything at the same level or better go next. */
+		preempt = runqueue_bestprio(curcpu->c_self) <= cur->t_priority;
+	}
+	else {
+		/* Otherwise, only give way to something more important. */
+		preempt = runqueue_bestprio(curcpu->c_self) < cur->t_priority;
+	}
+
 	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
+	 * If we're not switching, nothing needs doing here until the
+	 * current time slice runs out, so don't tick until then.
+	 * (Tickless operation; see clock.c. Anything that becomes
+	 * runnable here in the meantime turns the tick back on.)
+	 * This must happen before yielding, since we might come back
+	 * on another cpu.
 	 */
+	period = preempt ? 1 : cur->t_quantum;
+	hardclock_setperiod(period);
+	ticketlock_release(&curcpu->c_runqueue_lock);
+
+	if (preempt) {
+		thread_yield();
+	}
+}
+
+/*
+ * Boost a thread that is being woken up. This is called only on
+ * threads just taken off a wait channel, so nobody else can be
+ * looking at the scheduler fields and no lock is needed.
+ */
+static
+void
+thread_wakeup_boost(struct thread *target)
+{
+	if (target->t_priority > 0) {
+		target->t_priority--;
+	}
+	target->t_quantum = SCHED_QUANTUM(target->t_priority);
+}
+
+/*
+ * Periodic priority boost: move everything on the current cpu's run
+ * queues, and the current thread, back to the top priority level.
+ */
+void
+schedule(void)
+{
+	struct thread *t;
+	int i;
+
+	ticketlock_acquire(&curcpu->c_runqueue_lock);
+	for (i=1; i<SCHED_NPRIO; i++) {
+		while ((t = threadlist_remhead(&curcpu->c_runqueue[i])) != NULL) {
+			t->t_priority = 0;
+			t->t_quantum = SCHED_QUANTUM(0);
+			threadlist_addtail(&curcpu->c_runqueue[0], t);
+		}
+	}
+	if (!curcpu->c_isidle) {
+		curthread->t_priority = 0;
+		curthread->t_quantum = SCHED_QUANTUM(0);
+	}
+	ticketlock_release(&curcpu->c_runqueue_lock);
 }
 
+#endif /* OPT_FAIRSCHED */
+
 /*
  * Thread migration.
  *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
+ * Load is balanced by pulling rather than pushing: a cpu that is
+ * about to go idle looks for another cpu with threads waiting on its
+ * run queue and steals one from the tail (see thread_steal, called
+ * from thread_switch), and periodically, from hardclock(), a cpu with
+ * a noticeably shorter run queue than some other cpu pulls a thread
+ * over (thread_consider_migration). Victims are chosen by looking at
+ * c_runqueue_hint without taking any locks, starting from a random
+ * cpu so that several idle cpus don't all pile onto the same victim.
  *
  * Migrating threads isn't free because of cache affinity; a thread's
  * working cache set will end up having to be moved to the other CPU,
@@ -852,49 +1543,69 @@ schedule(void)
  * System/161 does not (yet) model such cache effects, we'll be very
  * aggressive.
  */
-void
-thread_consider_migration(void)
+
+/*
+ * Cheap per-cpu pseudo-random numbers for picking victims. (xorshift;
+ * this doesn't need to be good, just not the same on every cpu.)
+ */
+static
+uint32_t
+thread_steal_random(void)
+{
+	uint32_t x;
+
+	x = curcpu->c_stealseed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	curcpu->c_stealseed = x;
+	return x;
+}
+
+/*
+ * Steal a thread from the tail of some other cpu's run queue, trying
+ * only cpus that appear to have at least MINWAITING threads waiting.
+ * The stolen thread is returned, already assigned to the current cpu
+ * but not on any run queue; NULL is returned if nothing was found.
+ *
+ * Must not be called with any run queue lock held, since we lock the
+ * victim's.
+ */
+static
+struct thread *
+thread_steal(unsigned minwaiting)
 {
-	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
+	unsigned numcpus, start, i;
 	struct cpu *c;
-	struct threadlist victims;
 	struct thread *t;
 
-	my_count = total_count = 0;
-	numcpus = cpuarray_num(&allcpus);
-	for (i=0; i<numcpus; i++) {
-		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
-		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
-		}
-		spinlock_release(&c->c_runqueue_lock);
-	}
+	KASSERT(minwaiting > 0);
 
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
-		return;
+	numcpus = cpuarray_num(&allcpus);
+	if (numcpus == 1) {
+		return NULL;
 	}
 
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
-	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
-	}
-	spinlock_release(&curcpu->c_runqueue_lock);
+	start = thread_steal_random() % numcpus;
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, (start + i) % numcpus);
+		if (c == curcpu->c_self || c->c_runqueue_hint < minwaiting) {
+			continue;
+		}
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
-		c = cpuarray_get(&allcpus, i);
-		if (c == curcpu->c_self) {
+		ticketlock_acquire(&c->c_runqueue_lock);
+		if (c->c_isidle || runqueue_count(c) < minwaiting) {
+			/*
+			 * Either the hint was stale, or the cpu is
+			 * idle and already on its way to run what it
+			 * has. Leave it alone.
+			 */
+			ticketlock_release(&c->c_runqueue_lock);
 			continue;
 		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
+		t = runqueue_remtail(c);
+		KASSERT(t != NULL);
+		if (t == c->c_curthread) {
 			/*
 			 * Ordinarily, curthread will not appear on
 			 * the run queue. However, it can under the
@@ -907,54 +1618,181 @@ thread_consider_migration(void)
 			 *   - and the processor hasn't fully unidled
 			 *     yet, so all these things are still true.
 			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
+			 * Migrating curthread can cause bad things to
+			 * happen (Exercise: Why? And what?) so put it
+			 * back where it was and look elsewhere.
 			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
+			runqueue_add(c, t);
+			ticketlock_release(&c->c_runqueue_lock);
+			continue;
+		}
+		t->t_cpu = curcpu->c_self;
+#if OPT_FAIRSCHED
+		runqueue_fair_leave(c, t);
+#endif
+		ticketlock_release(&c->c_runqueue_lock);
+#if OPT_FAIRSCHED
+		/*
+		 * Only this cpu moves its own c_minvruntime, from
+		 * thread_tick, and interrupts are off here, so it's
+		 * safe to look at without the lock. The thread might
+		 * be run straight away without going on a queue.
+		 */
+		runqueue_fair_arrive(curcpu->c_self, t);
+#endif
 
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
+		DEBUG(DB_THREADS, "Migrated thread %s: cpu %u -> %u",
+		      t->t_name, c->c_number, curcpu->c_number);
+#if OPT_SCHEDTRACE
+		if (schedtrace_enabled) {
+			schedtrace_migrate(t, c);
 		}
-		spinlock_release(&c->c_runqueue_lock);
+#endif
+		return t;
 	}
+	return NULL;
+}
 
-	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
-	 */
-	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+/*
+ * Wake up an idle cpu, if there is one, so it can come and steal
+ * work from BUSY, whose run queue just got longer. Without this,
+ * idle cpus would sleep through new work arriving on busy ones until
+ * some unrelated interrupt came along.
+ */
+static
+void
+thread_kick_idle(struct cpu *busy)
+{
+	unsigned numcpus, start, i;
+	struct cpu *c;
+
+	numcpus = cpuarray_num(&allcpus);
+	if (numcpus == 1) {
+		return;
+	}
+
+	start = thread_steal_random() % numcpus;
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, (start + i) % numcpus);
+		/* Unlocked peek at c_isidle; at worst a wasted IPI. */
+		if (c != busy && c->c_isidle) {
+			ipi_send(c, IPI_UNIDLE);
+			return;
 		}
-		spinlock_release(&curcpu->c_runqueue_lock);
+	}
+}
+
+/*
+ * Periodic load balancing, called from hardclock(). If some other cpu
+ * has at least two more threads waiting than we do, take one.
+ */
+void
+thread_consider_migration(void)
+{
+	struct thread *t;
+
+	t = thread_steal(curcpu->c_runqueue_hint + 2);
+	if (t == NULL) {
+		return;
 	}
 
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
+	ticketlock_acquire(&curcpu->c_runqueue_lock);
+	runqueue_add(curcpu->c_self, t);
+	ticketlock_release(&curcpu->c_runqueue_lock);
+}
+
+/*
+ * Wakeup placement.
+ *
+ * A thread being woken normally goes back on the cpu it last ran on,
+ * where its cache footprint might still be. But if that cpu is busy,
+ * the thread has to wait for it even though another cpu might be
+ * idle, or the waker's cpu might be about to have nothing to do (the
+ * usual state of affairs in a producer/consumer pipeline). So:
+ *
+ *    - if the previous cpu is idle, use it;
+ *    - otherwise, if some cpu is idle, use that, looking at the
+ *      waker's cpu first;
+ *    - otherwise, if threads are already waiting on the previous cpu
+ *      and none are waiting on the waker's, use the waker's cpu, on
+ *      the theory that the waker will block soon;
+ *    - otherwise stay put.
+ *
+ * The last case isn't used when waking from an interrupt handler,
+ * since the interrupted thread isn't waiting for anything.
+ *
+ * If the thread is still its previous cpu's c_curthread (see the
+ * comment in thread_steal), it must not be moved, but then that cpu
+ * is idle anyway. Holding the previous cpu's run queue lock while
+ * checking guarantees the thread is not in the middle of switching
+ * out.
+ *
+ * This is only done for wchan_wakeone; wchan_wakeall leaves threads
+ * on their previous cpus so it can batch them, and relies on
+ * thread_kick_idle to spread them around.
+ */
+static
+void
+thread_wakeup_place(struct thread *target)
+{
+	struct cpu *prev, *best, *c;
+	unsigned numcpus, start, i;
+
+	prev = target->t_cpu;
+	best = NULL;
+
+	ticketlock_acquire(&prev->c_runqueue_lock);
+	if (prev->c_isidle || prev->c_curthread == target) {
+		best = prev;
+	}
+	else {
+		/* Unlocked peeks at c_isidle, as in thread_kick_idle. */
+		numcpus = cpuarray_num(&allcpus);
+		start = curcpu->c_number;
+		for (i=0; i<numcpus; i++) {
+			c = cpuarray_get(&allcpus, (start + i) % numcpus);
+			if (c != prev && c->c_isidle) {
+				best = c;
+				curcpu->c_wake_idle++;
+				break;
+			}
+		}
+	}
+	if (best == NULL && !curthread->t_in_interrupt &&
+	    curcpu->c_self != prev && curcpu->c_runqueue_hint == 0 &&
+	    runqueue_count(prev) > 0) {
+		best = curcpu->c_self;
+		curcpu->c_wake_waker++;
+	}
+	if (best == NULL || best == prev) {
+		best = prev;
+		curcpu->c_wake_prev++;
+	}
+	else {
+		DEBUG(DB_THREADS, "Woke thread %s: cpu %u -> %u",
+		      target->t_name, prev->c_number, best->c_number);
+	}
+#if OPT_FAIRSCHED
+	if (best != prev) {
+		runqueue_fair_leave(prev, target);
+	}
+#endif
+	target->t_cpu = best;
+	ticketlock_release(&prev->c_runqueue_lock);
+}
+
+void
+thread_wakestats(void)
+{
+	unsigned i;
+	struct cpu *c;
+
+	kprintf("cpu    previous       idle      waker\n");
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("%3u %10u %10u %10u\n", c->c_number,
+			c->c_wake_prev, c->c_wake_idle, c->c_wake_waker);
+	}
 }
 
 ////////////////////////////////////////////////////////////
@@ -1050,6 +1888,8 @@ wchan_wakeone(struct wchan *wc)
 		return;
 	}
 
+	thread_wakeup_boost(target);
+	thread_wakeup_place(target);
 	thread_make_runnable(target, false);
 }
 
@@ -1060,9 +1900,12 @@ void
 wchan_wakeall(struct wchan *wc)
 {
 	struct thread *target;
-	struct threadlist list;
+	struct threadlist list, others;
+	struct cpu *targetcpu;
+	bool isidle;
 
 	threadlist_init(&list);
+	threadlist_init(&others);
 
 	/*
 	 * Lock the channel and grab all the threads, moving them to a
@@ -1079,14 +1922,38 @@ wchan_wakeall(struct wchan *wc)
 	spinlock_release(&wc->wc_lock);
 
 	/*
-	 * We could conceivably sort by cpu first to cause fewer lock
-	 * ops and fewer IPIs, but for now at least don't bother. Just
-	 * make each thread runnable.
+	 * Sort by cpu: take the cpu of the first thread left, lock its
+	 * run queue once, move every thread for that cpu onto it, and
+	 * notify it (at most one IPI) once. Threads for other cpus are
+	 * set aside for the next round.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
-		thread_make_runnable(target, false);
+		targetcpu = target->t_cpu;
+		ticketlock_acquire(&targetcpu->c_runqueue_lock);
+		isidle = targetcpu->c_isidle;
+		do {
+			if (target->t_cpu == targetcpu) {
+				thread_wakeup_boost(target);
+				runqueue_add(targetcpu, target);
+#if OPT_SCHEDTRACE
+				if (schedtrace_enabled) {
+					schedtrace_wakeup(target, targetcpu);
+				}
+#endif
+			}
+			else {
+				threadlist_addtail(&others, target);
+			}
+		} while ((target = threadlist_remhead(&list)) != NULL);
+		thread_notify_cpu(targetcpu, isidle);
+		ticketlock_release(&targetcpu->c_runqueue_lock);
+
+		while ((target = threadlist_remhead(&others)) != NULL) {
+			threadlist_addtail(&list, target);
+		}
 	}
 
+	threadlist_cleanup(&others);
 	threadlist_cleanup(&list);
 }
 
@@ -1177,20 +2044,25 @@ interprocessor_interrupt(void)
 	}
 	if (bits & (1U << IPI_OFFLINE)) {
 		/* offline request */
-		spinlock_acquire(&curcpu->c_runqueue_lock);
+		ticketlock_acquire(&curcpu->c_runqueue_lock);
 		if (!curcpu->c_isidle) {
 			kprintf("cpu%d: offline: warning: not idle\n",
 				curcpu->c_number);
 		}
-		spinlock_release(&curcpu->c_runqueue_lock);
+		ticketlock_release(&curcpu->c_runqueue_lock);
 		kprintf("cpu%d: offline.\n", curcpu->c_number);
 		cpu_halt();
 	}
 	if (bits & (1U << IPI_UNIDLE)) {
 		/*
 		 * The cpu has already unidled itself to take the
-		 * interrupt; don't need to do anything else.
+		 * interrupt. If it wasn't idle, it may have stopped
+		 * ticking because it had only one thread to run;
+		 * something else is runnable now, so start again.
 		 */
+		if (!curcpu->c_isidle) {
+			hardclock_setperiod(1);
+		}
 	}
 	if (bits & (1U << IPI_TLBSHOOTDOWN)) {
 		if (curcpu->c_numshootdown == TLBSHOOTDOWN_ALL) {
@@ -192,10 +192,11 @@ static struct pageref *allbase;
  * Use one spinlock for the whole thing. Making parts of the kmalloc
  * logic per-cpu is worthwhile for scalability; however, for the time
  * being at least we won't, because it adds a lot of complexity and in
- * OS/161 performance and scalability aren't super-critical.
+ * OS/161 performance and scalability aren't super-critical. It's a
+ * ticket lock, so at least everyone gets their turn.
  */
 
-static struct spinlock kmalloc_spinlock = SPINLOCK_INITIALIZER;
+static struct ticketlock kmalloc_spinlock = TICKETLOCK_INITIALIZER;
 
 ////////////////////////////////////////
 
@@ -216,7 +217,7 @@ checksubpage(struct pageref *pr)
 	int blktype;
 	int nfree=0;
 
-	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+	KASSERT(ticketlock_do_i_hold(&kmalloc_spinlock));
 
 	if (pr->freelist_offset == INVALID_OFFSET) {
 		KASSERT(pr->nfree==0);
@@ -255,7 +256,7 @@ checksubpages(void)
 	int i;
 	unsigned sc=0, ac=0;
 
-	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+	KASSERT(ticketlock_do_i_hold(&kmalloc_spinlock));
 
 	for (i=0; i<NSIZES; i++) {
 		for (pr = sizebases[i]; pr != NULL; pr = pr->next_samesize) {
@@ -290,7 +291,7 @@ dumpsubpage(struct pageref *pr)
 	uint32_t freemap[PAGE_SIZE / (SMALLEST_SUBPAGE_SIZE*32)];
 
 	checksubpage(pr);
-	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+	KASSERT(ticketlock_do_i_hold(&kmalloc_spinlock));
 
 	/* clear freemap[] */
 	for (i=0; i<sizeof(freemap)/sizeof(freemap[0]); i++) {
@@ -336,7 +337,7 @@ kheap_printstats(void)
 	struct pageref *pr;
 
 	/* print the whole thing with interrupts off */
-	spinlock_acquire(&kmalloc_spinlock);
+	ticketlock_acquire(&kmalloc_spinlock);
 
 	kprintf("Subpage allocator status:\n");
 
@@ -344,7 +345,7 @@ kheap_printstats(void)
 		dumpsubpage(pr);
 	}
 
-	spinlock_release(&kmalloc_spinlock);
+	ticketlock_release(&kmalloc_spinlock);
 }
 
 ////////////////////////////////////////
@@ -409,7 +410,7 @@ subpage_kmalloc(size_t sz)
 	blktype = blocktype(sz);
 	sz = sizes[blktype];
 
-	spinlock_acquire(&kmalloc_spinlock);
+	ticketlock_acquire(&kmalloc_spinlock);
 
 	checksubpages();
 
@@ -445,7 +446,7 @@ subpage_kmalloc(size_t sz)
 
 			checksubpages();
 
-			spinlock_release(&kmalloc_spinlock);
+			ticketlock_release(&kmalloc_spinlock);
 			return retptr;
 		}
 	}
@@ -459,19 +460,19 @@ subpage_kmalloc(size_t sz)
 	 * Note that this means things can change behind our back...
 	 */
 
-	spinlock_release(&kmalloc_spinlock);
+	ticketlock_release(&kmalloc_spinlock);
 	prpage = alloc_kpages(1);
 	if (prpage==0) {
 		/* Out of memory. */
 		kprintf("kmalloc: Subpage allocator couldn't get a page\n"); 
 		return NULL;
 	}
-	spinlock_acquire(&kmalloc_spinlock);
+	ticketlock_acquire(&kmalloc_spinlock);
 
 	pr = allocpageref();
 	if (pr==NULL) {
 		/* Couldn't allocate accounting space for the new page. */
-		spinlock_release(&kmalloc_spinlock);
+		ticketlock_release(&kmalloc_spinlock);
 		free_kpages(prpage);
 		kprintf("kmalloc: Subpage allocator couldn't get pageref\n"); 
 		return NULL;
@@ -522,7 +523,7 @@ subpage_kfree(void *ptr)
 
 	ptraddr = (vaddr_t)ptr;
 
-	spinlock_acquire(&kmalloc_spinlock);
+	ticketlock_acquire(&kmalloc_spinlock);
 
 	checksubpages();
 
@@ -541,7 +542,7 @@ subpage_kfree(void *ptr)
 
 	if (pr==NULL) {
 		/* Not on any of our pages - not a subpage allocation */
-		spinlock_release(&kmalloc_spinlock);
+		ticketlock_release(&kmalloc_spinlock);
 		return -1;
 	}
 
@@ -579,17 +580,17 @@ subpage_kfree(void *ptr)
 		remove_lists(pr, blktype);
 		freepageref(pr);
 		/* Call free_kpages without kmalloc_spinlock. */
-		spinlock_release(&kmalloc_spinlock);
+		ticketlock_release(&kmalloc_spinlock);
 		free_kpages(prpage);
 	}
 	else {
-		spinlock_release(&kmalloc_spinlock);
+		ticketlock_release(&kmalloc_spinlock);
 	}
 
 #ifdef SLOWER /* Don't get the lock unless checksubpages does something. */
-	spinlock_acquire(&kmalloc_spinlock);
+	ticketlock_acquire(&kmalloc_spinlock);
 	checksubpages();
-	spinlock_release(&kmalloc_spinlock);
+	ticketlock_release(&kmalloc_spinlock);
 #endif
 
 	return 0;
@@ -28,6 +28,7 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
 #include <err.h>
 
 /*
@@ -36,28 +37,19 @@
  */
 
 
-/* Copy one file to another. */
+/* How much to ask copyfile for at a time. */
+#define COPYCHUNK (1024*1024)
+
+/*
+ * Copy the rest of FROMFD to TOFD with read and write.
+ */
 static
 void
-copy(const char *from, const char *to)
+copy_rw(int fromfd, const char *from, int tofd, const char *to)
 {
-	int fromfd;
-	int tofd;
 	char buf[1024];
 	int len, wr, wrtot;
 
-	/*
-	 * Open the files, and give up if they won't open
-	 */
-	fromfd = open(from, O_RDONLY);
-	if (fromfd<0) {
-		err(1, "%s", from);
-	}
-	tofd = open(to, O_WRONLY|O_CREAT|O_TRUNC);
-	if (tofd<0) {
-		err(1, "%s", to);
-	}
-
 	/*
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
@@ -84,6 +76,46 @@ copy(const char *from, const char *to)
 	if (len<0) {
 		err(1, "%s", from);
 	}
+}
+
+/* Copy one file to another. */
+static
+void
+copy(const char *from, const char *to)
+{
+	int fromfd;
+	int tofd;
+	off_t pos;
+	int len;
+
+	/*
+	 * Open the files, and give up if they won't open
+	 */
+	fromfd = open(from, O_RDONLY);
+	if (fromfd<0) {
+		err(1, "%s", from);
+	}
+	tofd = open(to, O_WRONLY|O_CREAT|O_TRUNC);
+	if (tofd<0) {
+		err(1, "%s", to);
+	}
+
+	/*
+	 * Have the kernel move the data, a chunk at a time, until it
+	 * reports EOF by copying nothing. If the source can't seek
+	 * (ESPIPE) or there's no copyfile (ENOSYS), fall back to
+	 * reading and writing it ourselves.
+	 */
+	pos = 0;
+	while ((len = copyfile(fromfd, tofd, pos, COPYCHUNK))>0) {
+		pos += len;
+	}
+	if (len<0 && pos==0 && (errno==ESPIPE || errno==ENOSYS)) {
+		copy_rw(fromfd, from, tofd, to);
+	}
+	else if (len<0) {
+		err(1, "%s to %s", from, to);
+	}
 
 	if (close(fromfd) < 0) {
 		err(1, "%s: close", from);
@@ -354,6 +354,7 @@ docommand(char *buf)
 		__time(&startsecs, &startnsecs);
 	}
 
+#ifdef HOST
 	pid = fork();
 	switch (pid) {
 		case -1:
@@ -375,6 +376,18 @@ docommand(char *buf)
 		default:
 			break;
 	}
+#else
+	/*
+	 * Fork and exec in one system call. Errors finding or
+	 * loading the program come back here rather than from a
+	 * child.
+	 */
+	pid = spawn(args[0], args);
+	if (pid < 0) {
+		warn("%s", args[0]);
+		return _MKWAIT_EXIT(1);
+	}
+#endif
 
 	/* parent */
 	if (bg) {
@@ -41,6 +41,8 @@
 #include <kern/ioctl.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
+#include <kern/syscallstat.h>
+#include <kern/sysring.h>
 #include <kern/time.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
@@ -147,6 +149,8 @@ int chdir(const char *path);
 
 /* Optional. */
 void *sbrk(int change);
+pid_t vfork(void);
+pid_t spawn(const char *prog, char *const *args);
 int getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 int readlink(const char *path, char *buf, size_t buflen);
@@ -154,6 +158,16 @@ int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
 int __getcwd(char *buf, size_t buflen);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int futex_wait(volatile int *addr, int expected);
+int futex_wake(volatile int *addr, int n);
+int __threadfork(void (*start)(void), void (*func)(void *), void *arg);
+__DEAD void threadexit(int code);
+int threadjoin(int tid, int *code);
+int setpriority(int which, int who, int prio);
+int syscallstats(int callno, struct syscallstats *stats);
+int sysring_enter(struct sysring *ring);
+int copyfile(int fromhandle, int tohandle, off_t offset, size_t len);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -162,6 +176,7 @@ int __getcwd(char *buf, size_t buflen);
  */
 
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
+int threadfork(void (*func)(void *), void *arg);	/* calls __threadfork */
 time_t time(time_t *seconds);			/* calls __time */
 
 #endif /* _UNISTD_H_ */
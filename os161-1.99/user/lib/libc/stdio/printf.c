@@ -29,11 +29,51 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 /*
  * printf - C standard I/O function.
+ *
+ * Rather than a write per character, the output of one printf call
+ * is gathered into a list of pieces and sent with writev, normally
+ * all at once.
+ *
+ * __vprintf hands us long strings (%s arguments, which stay put
+ * until printf returns) by pointer, so those go in the list as they
+ * are. Short pieces (single characters of the format, padding, and
+ * converted numbers, which __vprintf builds on its stack and will
+ * have reused by the time we write) are copied into a small buffer,
+ * with consecutive ones sharing one list entry.
  */
 
+#define PRINTF_NIOV	16	/* pieces per writev */
+#define PRINTF_BUFSIZE	128	/* space for copied pieces */
+#define PRINTF_COPYMAX	32	/* pieces shorter than this get copied */
+
+struct printf_state {
+	struct iovec iov[PRINTF_NIOV];
+	int niov;
+	char buf[PRINTF_BUFSIZE];
+	size_t buflen;
+	int lastcopied;		/* last entry points into buf */
+};
+
+/*
+ * Write out what we've got.
+ */
+static
+void
+__printf_flush(struct printf_state *ps)
+{
+	if (ps->niov > 0) {
+		writev(STDOUT_FILENO, ps->iov, ps->niov);
+	}
+	ps->niov = 0;
+	ps->buflen = 0;
+	ps->lastcopied = 0;
+}
 
 /*
  * Function passed to __vprintf to do the actual output.
@@ -42,12 +82,38 @@ static
 void
 __printf_send(void *mydata, const char *data, size_t len)
 {
-	unsigned i;
-	(void)mydata;  /* not needed */
+	struct printf_state *ps = mydata;
+
+	if (len == 0) {
+		return;
+	}
+
+	if (len >= PRINTF_COPYMAX) {
+		if (ps->niov == PRINTF_NIOV) {
+			__printf_flush(ps);
+		}
+		ps->iov[ps->niov].iov_base = (void *)data;
+		ps->iov[ps->niov].iov_len = len;
+		ps->niov++;
+		ps->lastcopied = 0;
+		return;
+	}
 
-	for (i=0; i<len; i++) {
-		putchar(data[i]);
+	if (ps->buflen + len > PRINTF_BUFSIZE ||
+	    (!ps->lastcopied && ps->niov == PRINTF_NIOV)) {
+		__printf_flush(ps);
 	}
+	memcpy(ps->buf + ps->buflen, data, len);
+	if (ps->lastcopied) {
+		ps->iov[ps->niov - 1].iov_len += len;
+	}
+	else {
+		ps->iov[ps->niov].iov_base = ps->buf + ps->buflen;
+		ps->iov[ps->niov].iov_len = len;
+		ps->niov++;
+		ps->lastcopied = 1;
+	}
+	ps->buflen += len;
 }
 
 /* printf: hand off to vprintf */
@@ -62,9 +128,17 @@ printf(const char *fmt, ...)
 	return chars;
 }
 
-/* vprintf: call __vprintf to do the work. */
+/* vprintf: call __vprintf to do the work, then send the output. */
 int
 vprintf(const char *fmt, va_list ap)
 {
-	return __vprintf(__printf_send, NULL, fmt, ap);
+	struct printf_state ps;
+	int chars;
+
+	ps.niov = 0;
+	ps.buflen = 0;
+	ps.lastcopied = 0;
+	chars = __vprintf(__printf_send, &ps, fmt, ap);
+	__printf_flush(&ps);
+	return chars;
 }
@@ -34,6 +34,10 @@
  *
  * It should also continue to work after subsequent assignments, most
  * notably after implementing the virtual memory system.
+ *
+ * With -b, instead time forking (and waiting for) a series of children
+ * that exit right away, and report forks per second. -v does the same
+ * with vfork.
  */
 
 #include <unistd.h>
@@ -41,6 +45,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <err.h>
+#include <sys/wait.h>
+
+/* Default number of forks for -b. */
+#define BENCH_FORKS 200
 
 /*
  * This is used by all processes, to try to help make sure all
@@ -166,16 +174,62 @@ test(int nowait)
 	putchar('\n');
 }
 
+/*
+ * Fork benchmark: fork (or vfork) COUNT children one at a time, each
+ * of which exits immediately, and wait for each.
+ */
+static
+void
+bench(int count, int usevfork)
+{
+	time_t startsecs, endsecs;
+	unsigned long startnsecs, endnsecs;
+	unsigned long long usecs;
+	int i, pid, x;
+
+	__time(&startsecs, &startnsecs);
+	for (i=0; i<count; i++) {
+		pid = usevfork ? vfork() : fork();
+		if (pid < 0) {
+			err(1, "%s", usevfork ? "vfork" : "fork");
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		if (waitpid(pid, &x, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(x) || WEXITSTATUS(x) != 0) {
+			errx(1, "pid %d: bad exit status %d", pid, x);
+		}
+	}
+	__time(&endsecs, &endnsecs);
+
+	usecs = (endsecs - startsecs) * 1000000ULL;
+	usecs += endnsecs / 1000;
+	usecs -= startnsecs / 1000;
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	printf("%d forks in %llu us: %llu forks/sec\n", count, usecs,
+	       count * 1000000ULL / usecs);
+}
+
 int
 main(int argc, char *argv[])
 {
 	int nowait=0;
 
+	if (argc>=2 && (!strcmp(argv[1], "-b") || !strcmp(argv[1], "-v"))) {
+		bench(argc>2 ? atoi(argv[2]) : BENCH_FORKS,
+		      argv[1][1] == 'v');
+		return 0;
+	}
 	if (argc==2 && !strcmp(argv[1], "-w")) {
 		nowait=1;
 	}
 	else if (argc!=1 && argc!=0) {
-		warnx("usage: forktest [-w]");
+		warnx("usage: forktest [-w] | -b [count] | -v [count]");
 		return 1;
 	}
 	warnx("Starting.");
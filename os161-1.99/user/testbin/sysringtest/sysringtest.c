@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * sysringtest.c
+ *
+ * 	Tests batched system calls through sysring_enter.
+ *
+ * Queues a mix of writes, lseeks, and reads on a scratch file, plus
+ * calls that aren't allowed in a ring, and checks each entry's
+ * results and how far the head moved. Then checks that a ring that
+ * runs off the end of the address space stops at the first entry it
+ * can't reach, with the head left pointing at it.
+ *
+ * Creates a scratch file in the current directory.
+ */
+
+#include <sys/types.h>
+#include <kern/syscall.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define TESTFILE	"sysringtest.tmp"
+#define BADCALLNO	9999
+#define INVAL_PTR	((void *)0x40000000)	/* addr not part of program */
+#define PAGE_SIZE	4096
+
+/* Provided by the linker script: the end of the data segment. */
+extern char _end[];
+
+static struct sysring ring;
+static int failures;
+
+/*
+ * Add a call with NARGS argument words to the tail of R.
+ */
+static
+struct sysring_entry *
+queue(struct sysring *r, int callno, int nargs, ...)
+{
+	struct sysring_entry *se;
+	va_list ap;
+	int i;
+
+	se = &r->sr_entries[r->sr_tail % SYSRING_SIZE];
+	se->se_callno = callno;
+	va_start(ap, nargs);
+	for (i=0; i<SYSRING_MAXARGS; i++) {
+		se->se_args[i] = (i < nargs) ? va_arg(ap, uint32_t) : 0;
+	}
+	va_end(ap);
+	/* So we can tell if the kernel wrote them. */
+	se->se_error = -1;
+	se->se_retval = -1;
+	r->sr_tail++;
+	return se;
+}
+
+/*
+ * lseek's 64-bit offset goes in an aligned pair of words (the high
+ * half first), which leaves word 1 unused.
+ */
+static
+struct sysring_entry *
+queue_lseek(struct sysring *r, int fd, off_t pos, int whence)
+{
+	return queue(r, SYS_lseek, 5, (uint32_t)fd, 0,
+		     (uint32_t)(pos >> 32), (uint32_t)pos, (uint32_t)whence);
+}
+
+static
+void
+check(const char *what, struct sysring_entry *se, int error, int64_t retval)
+{
+	if (se->se_error != error || se->se_retval != retval) {
+		warnx("FAILED: %s: got error %d retval %lld, "
+		      "expected error %d retval %lld", what,
+		      se->se_error, se->se_retval, error, retval);
+		failures++;
+	}
+}
+
+static
+void
+check_enter(const char *what, struct sysring *r, int expected_rv,
+	    int expected_errno, unsigned expected_head)
+{
+	int rv;
+
+	errno = 0;
+	rv = sysring_enter(r);
+	if (rv != expected_rv || (rv < 0 && errno != expected_errno)) {
+		warnx("FAILED: %s: sysring_enter returned %d (errno %d), "
+		      "expected %d (errno %d)", what, rv, errno,
+		      expected_rv, expected_errno);
+		failures++;
+	}
+	if (r->sr_head != expected_head) {
+		warnx("FAILED: %s: head is %u, expected %u", what,
+		      r->sr_head, expected_head);
+		failures++;
+	}
+}
+
+/*
+ * Writes, seeks, and a read on a scratch file, with some calls that
+ * must be refused mixed in. Refused and failed calls don't stop the
+ * ones after them.
+ */
+static
+void
+test_mixed(int fd)
+{
+	struct sysring_entry *w1, *w2, *bad, *getpid_, *badfd, *s1, *r1, *s2;
+	char buf[16];
+
+	memset(buf, 0, sizeof(buf));
+	ring.sr_head = ring.sr_tail = 0;
+
+	w1 = queue(&ring, SYS_write, 3, fd, (uint32_t)"hello", 5);
+	bad = queue(&ring, BADCALLNO, 0);
+	w2 = queue(&ring, SYS_write, 3, fd, (uint32_t)" world", 6);
+	getpid_ = queue(&ring, SYS_getpid, 0);
+	badfd = queue(&ring, SYS_write, 3, -1, (uint32_t)"x", 1);
+	s1 = queue_lseek(&ring, fd, 0, SEEK_SET);
+	r1 = queue(&ring, SYS_read, 3, fd, (uint32_t)buf, sizeof(buf));
+	s2 = queue_lseek(&ring, fd, -5, SEEK_END);
+
+	check_enter("mixed", &ring, 8, 0, 8);
+	check("write", w1, 0, 5);
+	check("bad call number", bad, ENOSYS, 0);
+	check("second write", w2, 0, 6);
+	check("unbatchable call", getpid_, ENOSYS, 0);
+	check("write to bad fd", badfd, EBADF, 0);
+	check("lseek", s1, 0, 0);
+	check("read", r1, 0, 11);
+	check("lseek from end", s2, 0, 6);
+	if (strcmp(buf, "hello world") != 0) {
+		warnx("FAILED: read back \"%s\"", buf);
+		failures++;
+	}
+
+	/* Nothing pending: nothing to do. */
+	check_enter("empty", &ring, 0, 0, 8);
+}
+
+/*
+ * Indexes run freely; make sure they wrap around the ring.
+ */
+static
+void
+test_wrap(int fd)
+{
+	struct sysring_entry *se[4];
+	int i;
+
+	ring.sr_head = ring.sr_tail = SYSRING_SIZE - 2;
+	for (i=0; i<4; i++) {
+		se[i] = queue_lseek(&ring, fd, i, SEEK_SET);
+	}
+	check_enter("wraparound", &ring, 4, 0, SYSRING_SIZE + 2);
+	for (i=0; i<4; i++) {
+		check("wrapped lseek", se[i], 0, i);
+	}
+}
+
+/*
+ * Rings that are inconsistent or not there at all.
+ */
+static
+void
+test_badring(int fd)
+{
+	ring.sr_head = 0;
+	ring.sr_tail = 0;
+	queue_lseek(&ring, fd, 0, SEEK_SET);
+	ring.sr_tail = SYSRING_SIZE + 1;
+	check_enter("overfull ring", &ring, -1, EINVAL, 0);
+
+	errno = 0;
+	if (sysring_enter(INVAL_PTR) != -1 || errno != EFAULT) {
+		warnx("FAILED: unmapped ring: expected EFAULT (errno %d)",
+		      errno);
+		failures++;
+	}
+}
+
+/*
+ * Place a ring so that its header and first two entries are in the
+ * last page of the data segment and the rest is past it, where
+ * nothing is mapped (there's no heap unless malloc has been called).
+ * The two entries that are there should run and the head stop at
+ * the first one that isn't. The space used must be slack past _end,
+ * or we'd be scribbling on our own variables.
+ */
+static
+void
+test_fault(int fd)
+{
+	struct sysring *r;
+	struct sysring_entry *se[2];
+	uintptr_t pageend, size;
+	int i;
+
+	size = (uintptr_t)&ring.sr_entries[2] - (uintptr_t)&ring;
+	pageend = ((uintptr_t)_end + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE-1);
+	if (pageend - (uintptr_t)_end < size) {
+		printf("sysringtest: no slack after _end; "
+		       "skipping the fault test\n");
+		return;
+	}
+	r = (struct sysring *)(pageend - size);
+
+	r->sr_head = r->sr_tail = 0;
+	for (i=0; i<2; i++) {
+		se[i] = queue_lseek(r, fd, i, SEEK_SET);
+	}
+	/* These two are past the end; just move the tail over them. */
+	r->sr_tail += 2;
+
+	check_enter("ring past end of memory", r, 2, 0, 2);
+	for (i=0; i<2; i++) {
+		check("lseek before fault", se[i], 0, i);
+	}
+
+	/* Trying again gets nowhere. */
+	check_enter("ring at end of memory", r, -1, EFAULT, 2);
+}
+
+int
+main(void)
+{
+	int fd;
+
+	fd = open(TESTFILE, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", TESTFILE);
+	}
+
+	test_mixed(fd);
+	test_wrap(fd);
+	test_badring(fd);
+	test_fault(fd);
+
+	close(fd);
+	remove(TESTFILE);
+
+	if (failures > 0) {
+		errx(1, "%d checks failed", failures);
+	}
+	printf("sysringtest: passed\n");
+	return 0;
+}
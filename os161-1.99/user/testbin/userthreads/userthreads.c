@@ -30,19 +30,11 @@
 /*
  * Test multiple user level threads inside a process. The program
  * forks 3 threads off 2 to functions, each of which displays a string
- * every once in a while.
+ * every once in a while, and waits for them to finish.
  *
- * This won't do much of anything unless you implement user-level
- * threads.
- *
- * It also makes various assumptions about the thread API. In
- * particular, it believes (1) that you create a thread by calling
- * "threadfork()" and passing the address for execution of the new
- * thread to begin at, (2) that if the parent thread exits any child
- * threads will keep running, and (3) child threads will exit if they
- * return from the function they started in. If any or all of these
- * assumptions are not met by your user-level threads, you will need
- * to patch this test accordingly.
+ * The threads also bump a second counter, protected by a lock built
+ * on futex_wait and futex_wake, and check at the end that no
+ * increments were lost.
  *
  * This is also a rather basic test and you'll probably want to write
  * some more of your own.
@@ -51,46 +43,140 @@
 
 #include <unistd.h>
 #include <stdio.h>
+#include <err.h>
 
 #define NTHREADS  3
 #define MAX       1<<25
+#define LOCKED    20000
 
 /* counter for the loop in the threads : 
    This variable is shared and incremented by each 
    thread during his computation */
 volatile int count = 0;
 
+/* counter protected by the lock below */
+volatile int locked_count = 0;
+
+/*
+ * Simple futex lock: 0 is free, 1 is held, 2 is held with waiters.
+ */
+volatile int lock = 0;
+
+/*
+ * Compare and swap; returns the old value. There's nothing like this
+ * in libc, so use ll/sc directly, the way the kernel's spinlocks do.
+ */
+static
+int
+cas(volatile int *p, int old, int new)
+{
+    int prev, tmp;
+
+    __asm volatile(
+	".set push;"
+	".set mips32;"
+	"1: ll %0, 0(%2);"
+	"   bne %0, %3, 2f;"
+	"   move %1, %4;"
+	"   sc %1, 0(%2);"
+	"   beqz %1, 1b;"
+	"   nop;"
+	"2: .set pop"
+	: "=&r" (prev), "=&r" (tmp)
+	: "r" (p), "r" (old), "r" (new)
+	: "memory");
+    return prev;
+}
+
+static
+void
+lock_acquire(void)
+{
+    int c;
+
+    c = cas(&lock, 0, 1);
+    if (c == 0) {
+	/* Uncontended: no system call. */
+	return;
+    }
+    do {
+	if (c == 2 || cas(&lock, 1, 2) != 0) {
+	    futex_wait(&lock, 2);
+	}
+    } while ((c = cas(&lock, 0, 2)) != 0);
+}
+
+static
+void
+lock_release(void)
+{
+    if (cas(&lock, 1, 0) != 1) {
+	/* There might be waiters. */
+	lock = 0;
+	futex_wake(&lock, 1);
+    }
+}
+
 /* the 2 threads : */
-void ThreadRunner(void);
-void BladeRunner(void);
+void ThreadRunner(void *);
+void BladeRunner(void *);
 
 int
 main(int argc, char *argv[])
 {
-    int i;
+    int i, tids[NTHREADS], code;
 
     (void)argc;
     (void)argv;
 
     for (i=0; i<NTHREADS; i++) {
 	if (i)
-	    threadfork(ThreadRunner);
+	    tids[i] = threadfork(ThreadRunner, NULL);
         else
-	    threadfork(BladeRunner);
+	    tids[i] = threadfork(BladeRunner, NULL);
+	if (tids[i] < 0) {
+	    err(1, "threadfork");
+	}
+    }
+
+    printf("Parent is waiting.\n");
+    for (i=0; i<NTHREADS; i++) {
+	if (threadjoin(tids[i], &code) < 0) {
+	    err(1, "threadjoin %d", tids[i]);
+	}
     }
 
-    printf("Parent has left.\n");
+    if (locked_count != NTHREADS * LOCKED) {
+	errx(1, "FAILED: locked count %d, expected %d",
+	     locked_count, NTHREADS * LOCKED);
+    }
+    printf("\nPassed.\n");
     return 0;
 }
 
+static
+void
+locked_increments(void)
+{
+    int i;
+
+    for (i=0; i<LOCKED; i++) {
+	lock_acquire();
+	locked_count++;
+	lock_release();
+    }
+}
+
 /* multiple threads will simply print out the global variable.
    Even though there is no synchronization, we should get some 
    random results.
 */
 
 void
-BladeRunner()
+BladeRunner(void *arg)
 {
+    (void)arg;
+    locked_increments();
     while (count < MAX) {
 	if (count % 500 == 0)
 	    printf("Blade ");
@@ -99,12 +185,13 @@ BladeRunner()
 }
 
 void
-ThreadRunner()
+ThreadRunner(void *arg)
 {
+    (void)arg;
+    locked_increments();
     while (count < MAX) {
 	if (count % 513 == 0)
 	    printf(" Runner\n");
 	count++;
     }
 }
-    